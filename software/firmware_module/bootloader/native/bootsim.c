@@ -0,0 +1,279 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Emulated bus for the bootloader (BOOT_NATIVE). Runs several bootloaders in
+ * threads and connects them to a pseudo terminal, which can be used as device
+ * by the pc client (sfbus_ctrl -p /dev/pts/N -c flash ...).
+ * Every module receives its own copy of the bus bytes. Bytes can be corrupted
+ * randomly per module, to test the retransmission of missing pages.
+ *
+ * After the update a module runs a stub application, which answers ping and
+ * resets into the bootloader again on 0x31, so updates can be repeated.
+ *
+ * Usage: bootsim [-n modules] [-b first address] [-l loss per mille per byte]
+ */
+
+#define _GNU_SOURCE
+#include "boot.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define BOOTSIM_MAXMOD 64
+#define BOOTSIM_QUEUE 4096
+#define BOOTSIM_EEPROM_SIZE 512
+
+struct bootsim_module
+{
+    uint16_t address;
+    uint8_t flash[BOOT_START];
+    uint8_t eeprom[BOOTSIM_EEPROM_SIZE];
+    uint8_t queue[BOOTSIM_QUEUE];
+    uint16_t head;
+    uint16_t tail;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static struct bootsim_module modules[BOOTSIM_MAXMOD];
+static int module_count = 4;
+static int loss = 0; // per mille per byte
+static int pty_fd = -1;
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct bootsim_module *self = NULL;
+
+void boot_uart_init(void)
+{
+}
+
+uint8_t boot_uart_read(void)
+{
+    pthread_mutex_lock(&self->lock);
+    while (self->head == self->tail)
+    {
+        pthread_cond_wait(&self->cond, &self->lock);
+    }
+    uint8_t data = self->queue[self->tail];
+    self->tail = (self->tail + 1) % BOOTSIM_QUEUE;
+    pthread_mutex_unlock(&self->lock);
+    return data;
+}
+
+void boot_uart_write(uint8_t data)
+{
+    pthread_mutex_lock(&bus_lock);
+    if (write(pty_fd, &data, 1) != 1)
+    {
+        perror("bootsim: write failed");
+    }
+    pthread_mutex_unlock(&bus_lock);
+}
+
+uint8_t boot_eeprom_read(uint16_t address)
+{
+    return self->eeprom[address % BOOTSIM_EEPROM_SIZE];
+}
+
+void boot_eeprom_write(uint16_t address, uint8_t data)
+{
+    self->eeprom[address % BOOTSIM_EEPROM_SIZE] = data;
+}
+
+uint8_t boot_flash_read(uint16_t address)
+{
+    return address < BOOT_START ? self->flash[address] : 0xFF;
+}
+
+void boot_flash_page(uint16_t address, uint8_t *data)
+{
+    if (address + BOOT_PAGESIZE <= BOOT_START)
+    {
+        memcpy(self->flash + address, data, BOOT_PAGESIZE);
+    }
+}
+
+void boot_delay_slot(void)
+{
+    usleep(BOOT_SLOT_MS * 1000);
+}
+
+void boot_start_app(void)
+{
+    uint16_t crc = 0xFFFF;
+    uint16_t length = BOOT_START;
+    while (length > 0 && self->flash[length - 1] == 0xFF)
+    {
+        length--;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        crc ^= self->flash[i];
+        for (uint8_t j = 0; j < 8; j++)
+        {
+            crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    printf("module %u: application started, %u bytes, crc %04X\n", self->address, length, crc);
+    fflush(stdout);
+}
+
+// stub application: answer ping, return on reset into bootloader
+static void bootsim_app(void)
+{
+    uint8_t payload[256];
+    while (1)
+    {
+        while (boot_uart_read() != '+')
+        {
+        }
+        boot_uart_read(); // version
+        uint8_t length = boot_uart_read();
+        uint16_t dst = boot_uart_read();
+        dst |= (uint16_t)boot_uart_read() << 8;
+        for (uint8_t i = 0; length >= 3 && i < length - 3; i++)
+        {
+            payload[i] = boot_uart_read();
+        }
+        if (boot_uart_read() != '$' || length < 4 || dst != self->address)
+        {
+            continue;
+        }
+        if (payload[0] == BOOT_CMD_PING)
+        {
+            const uint8_t resp[] = {'+', 0, 4, BOOT_ADDR_MASTER & 0xFF, BOOT_ADDR_MASTER >> 8, BOOT_RESP_PING, '$'};
+            for (uint8_t i = 0; i < sizeof(resp); i++)
+            {
+                boot_uart_write(resp[i]);
+            }
+        }
+        else if (payload[0] == 0x31)
+        {
+            self->eeprom[BOOT_EE_STATE] = BOOT_STATE_UPDATE;
+            printf("module %u: reset into bootloader\n", self->address);
+            fflush(stdout);
+            return;
+        }
+    }
+}
+
+static void *bootsim_thread(void *arg)
+{
+    self = (struct bootsim_module *)arg;
+    while (1)
+    {
+        boot_main(); // returns when application is started
+        bootsim_app();
+    }
+    return NULL;
+}
+
+// copy byte into queue of every module, corrupt it randomly
+static void bootsim_push(uint8_t data)
+{
+    for (int i = 0; i < module_count; i++)
+    {
+        struct bootsim_module *module = &modules[i];
+        uint8_t value = data;
+        if (loss > 0 && rand() % 1000 < loss)
+        {
+            value ^= 1 << (rand() % 8);
+        }
+        pthread_mutex_lock(&module->lock);
+        uint16_t next = (module->head + 1) % BOOTSIM_QUEUE;
+        if (next != module->tail)
+        {
+            module->queue[module->head] = value;
+            module->head = next;
+        }
+        pthread_cond_signal(&module->cond);
+        pthread_mutex_unlock(&module->lock);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t base = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            module_count = atoi(optarg);
+            break;
+        case 'b':
+            base = strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            loss = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n modules] [-b first address] [-l loss per mille]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (module_count < 1 || module_count > BOOTSIM_MAXMOD)
+    {
+        fprintf(stderr, "bootsim: 1 to %d modules\n", BOOTSIM_MAXMOD);
+        return 2;
+    }
+
+    pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_fd < 0 || grantpt(pty_fd) || unlockpt(pty_fd))
+    {
+        perror("bootsim: cannot open pseudo terminal");
+        return 2;
+    }
+    // raw mode on slave side, until the client configures it
+    int slave_fd = open(ptsname(pty_fd), O_RDWR | O_NOCTTY);
+    struct termios options;
+    tcgetattr(slave_fd, &options);
+    cfmakeraw(&options);
+    tcsetattr(slave_fd, TCSANOW, &options);
+    fcntl(pty_fd, F_SETFL, O_NONBLOCK);
+
+    // modules with configured address and empty application section
+    for (int i = 0; i < module_count; i++)
+    {
+        struct bootsim_module *module = &modules[i];
+        module->address = base + i;
+        memset(module->flash, 0xFF, sizeof(module->flash));
+        memset(module->eeprom, 0xFF, sizeof(module->eeprom));
+        module->eeprom[BOOT_EE_ADDR] = module->address & 0xFF;
+        module->eeprom[BOOT_EE_ADDR + 1] = module->address >> 8;
+        module->eeprom[BOOT_EE_OKAY] = BOOT_EE_CONST_OKAY;
+        module->eeprom[BOOT_EE_STATE] = BOOT_STATE_UPDATE;
+        pthread_mutex_init(&module->lock, NULL);
+        pthread_cond_init(&module->cond, NULL);
+        pthread_create(&module->thread, NULL, bootsim_thread, module);
+    }
+    printf("%d modules (address %u-%u) on %s\n", module_count, base, base + module_count - 1, ptsname(pty_fd));
+    fflush(stdout);
+
+    uint8_t buffer[256];
+    while (1)
+    {
+        ssize_t count = read(pty_fd, buffer, sizeof(buffer));
+        if (count <= 0)
+        {
+            usleep(1000); // no data or client not connected
+            continue;
+        }
+        for (ssize_t i = 0; i < count; i++)
+        {
+            bootsim_push(buffer[i]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * SF-Bus bootloader. Located in the 1 KB boot section, started on every reset
+ * (BOOTRST). Starts the application immediately, unless the application
+ * requested an update (BOOT_EE_STATE) or the application section is empty.
+ *
+ * The image is sent once as broadcast pages. Every page is checked with a
+ * CRC16 before and after programming. The master collects the bitmaps of
+ * missing pages with a slotted query and resends only those pages.
+ *
+ * The frame buffer is on the stack, so the .noinit data of the application
+ * is not touched.
+ */
+
+#include "boot.h"
+
+BOOT_LOCAL uint16_t address = 0;
+BOOT_LOCAL uint8_t status = 0;
+BOOT_LOCAL uint8_t pages = 0;                    // pages of new image
+BOOT_LOCAL uint16_t image_crc = 0;               // crc of new image
+BOOT_LOCAL uint8_t received[BOOT_BITMAP_LEN];    // verified pages
+
+// MODBUS CRC16, same as calc_CRC16 on master
+static uint16_t boot_crc(uint16_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+static uint16_t boot_crc_flash(uint16_t start, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        crc = boot_crc(crc, boot_flash_read(start + i));
+    }
+    return crc;
+}
+
+// receive frame. Always reads the complete frame, as page data may contain
+// the start byte. returns payload length, 0 if frame is not for this node
+static uint8_t boot_recv_frame(uint8_t *payload, uint8_t *broadcast)
+{
+    while (boot_uart_read() != '+')
+    {
+    } // wait for start byte
+    if (boot_uart_read() != 0)
+    {
+        return 0;
+    }
+    uint8_t length = boot_uart_read();
+    uint16_t dst = boot_uart_read();
+    dst |= (uint16_t)boot_uart_read() << 8;
+    if (length < 3 || length - 3 > BOOT_MAXPKGLEN)
+    {
+        return 0;
+    }
+    length -= 3;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        payload[i] = boot_uart_read();
+    }
+    if (boot_uart_read() != '$')
+    {
+        return 0;
+    }
+    *broadcast = dst == BOOT_ADDR_BROADCAST ? 1 : 0;
+    if (dst != address && *broadcast == 0)
+    {
+        return 0;
+    }
+    return length;
+}
+
+static void boot_send_frame(uint8_t *payload, uint8_t length)
+{
+    boot_uart_write('+');
+    boot_uart_write(0);
+    boot_uart_write(length + 3);
+    boot_uart_write(BOOT_ADDR_MASTER & 0xFF);
+    boot_uart_write(BOOT_ADDR_MASTER >> 8);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        boot_uart_write(payload[i]);
+    }
+    boot_uart_write('$');
+}
+
+// program page, returns 1 if page was verified
+static uint8_t boot_page(uint8_t *payload)
+{
+    uint8_t page = payload[1];
+    uint8_t *data = payload + 2;
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < BOOT_PAGESIZE; i++)
+    {
+        crc = boot_crc(crc, data[i]);
+    }
+    if (page >= pages || crc != ((payload[BOOT_PAGESIZE + 2] << 8) | payload[BOOT_PAGESIZE + 3]))
+    {
+        return 0; // corrupted on the bus
+    }
+    uint16_t page_addr = (uint16_t)page * BOOT_PAGESIZE;
+    boot_flash_page(page_addr, data);
+    if (boot_crc_flash(page_addr, BOOT_PAGESIZE) != crc)
+    {
+        return 0; // programming failed
+    }
+    received[page >> 3] |= (1 << (page & 0x07));
+    return 1;
+}
+
+// check if all pages of image are received
+static uint8_t boot_complete(void)
+{
+    for (uint8_t page = 0; page < pages; page++)
+    {
+        if ((received[page >> 3] & (1 << (page & 0x07))) == 0)
+        {
+            return 0;
+        }
+    }
+    return pages > 0 ? 1 : 0;
+}
+
+// answer query <base addr> <count> in the slot of this node with
+// <addr> <status> <pages> <bitmap of missing pages>
+static void boot_query(uint8_t *payload)
+{
+    uint16_t base = (payload[1] << 8) | payload[2];
+    uint8_t count = payload[3];
+    if (address < base || address - base >= count)
+    {
+        return;
+    }
+    for (uint16_t slot = address - base; slot > 0; slot--)
+    {
+        boot_delay_slot();
+    }
+    payload[0] = address >> 8;
+    payload[1] = address & 0xFF;
+    payload[2] = status;
+    payload[3] = pages;
+    for (uint8_t i = 0; i < BOOT_BITMAP_LEN; i++)
+    {
+        payload[4 + i] = ~received[i];
+    }
+    boot_send_frame(payload, 4 + BOOT_BITMAP_LEN);
+}
+
+int boot_main(void)
+{
+    uint8_t payload[BOOT_MAXPKGLEN];
+    uint8_t broadcast = 0;
+    if (boot_eeprom_read(BOOT_EE_STATE) != BOOT_STATE_UPDATE &&
+        (boot_flash_read(0) != 0xFF || boot_flash_read(1) != 0xFF))
+    {
+        boot_start_app();
+        return 0;
+    }
+    if (boot_eeprom_read(BOOT_EE_OKAY) == BOOT_EE_CONST_OKAY)
+    {
+        address = boot_eeprom_read(BOOT_EE_ADDR) | (boot_eeprom_read(BOOT_EE_ADDR + 1) << 8);
+    }
+    boot_uart_init();
+    while (1)
+    {
+        uint8_t length = boot_recv_frame(payload, &broadcast);
+        if (length == 0)
+        {
+            continue;
+        }
+        if (payload[0] == BOOT_CMD_BEGIN && length >= 4 && payload[1] <= BOOT_APP_PAGES)
+        {
+            pages = payload[1];
+            image_crc = (payload[2] << 8) | payload[3];
+            for (uint8_t i = 0; i < BOOT_BITMAP_LEN; i++)
+            {
+                received[i] = 0;
+            }
+            status = BOOT_STS_RUNNING;
+            // stay in bootloader until image is complete
+            boot_eeprom_write(BOOT_EE_STATE, BOOT_STATE_UPDATE);
+        }
+        else if (payload[0] == BOOT_CMD_PAGE && length == BOOT_MAXPKGLEN && (status & BOOT_STS_RUNNING))
+        {
+            if (boot_page(payload) && boot_complete())
+            {
+                status |= BOOT_STS_COMPLETE;
+            }
+        }
+        else if (payload[0] == BOOT_CMD_QUERY && length >= 4)
+        {
+            boot_query(payload);
+        }
+        else if (payload[0] == BOOT_CMD_FINISH && (status & BOOT_STS_COMPLETE))
+        {
+            if (boot_crc_flash(0, (uint16_t)pages * BOOT_PAGESIZE) != image_crc)
+            {
+                status |= BOOT_STS_CRCERR;
+                continue;
+            }
+            boot_eeprom_write(BOOT_EE_STATE, 0xFF);
+            boot_start_app();
+            return 0;
+        }
+        else if (payload[0] == BOOT_CMD_PING && broadcast == 0)
+        {
+            payload[0] = BOOT_RESP_PING;
+            boot_send_frame(payload, 1);
+        }
+    }
+}
+
+#ifndef BOOT_NATIVE
+int main(void)
+{
+    return boot_main();
+}
+#endif
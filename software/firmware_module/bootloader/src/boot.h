@@ -0,0 +1,135 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+#pragma once
+#include <stdint.h>
+
+#define BOOT_START 0x1C00           // boot section (BOOTSZ = 01, hfuse 0xCA), first byte after application
+#define BOOT_PAGESIZE 64            // flash page size in bytes
+#define BOOT_APP_PAGES (BOOT_START / BOOT_PAGESIZE) // pages of application section
+#define BOOT_BITMAP_LEN (BOOT_APP_PAGES / 8)       // bytes of page bitmap
+#define BOOT_MAXPKGLEN (BOOT_PAGESIZE + 4)          // page command: opcode, page, data, crc
+
+#define BOOT_UART_BAUD 19200        // RS485 baud rate, 8N1
+#define BOOT_UBRR ((F_CPU) / (BOOT_UART_BAUD * 16UL) - 1)
+#define BOOT_SLOT_MS 20             // response slot length of query command
+#define BOOT_ADDR_BROADCAST 0xFFFE  // frames to this address are processed by all nodes
+#define BOOT_ADDR_MASTER 0xFFFF     // responses are sent to this address
+
+// EEPROM layout, shared with application
+#define BOOT_EE_ADDR 0x0000         // module address
+#define BOOT_EE_OKAY 0x0004         // configuration valid marker
+#define BOOT_EE_CONST_OKAY 0xAA
+#define BOOT_EE_STATE 0x01FF        // BOOT_STATE_UPDATE keeps the bootloader running
+#define BOOT_STATE_UPDATE 0x00
+
+// Command Bytes
+#define BOOT_CMD_BEGIN 0x50         // Start update: <pages> <image crc>
+#define BOOT_CMD_PAGE 0x51          // Page data: <page> <64 bytes> <crc>
+#define BOOT_CMD_QUERY 0x52         // Query missing pages: <base addr> <count>
+#define BOOT_CMD_FINISH 0x53        // Verify image and start application
+#define BOOT_CMD_PING 0xFE          // Ping
+#define BOOT_RESP_PING 0xFF
+
+// Status flags (query response)
+#define BOOT_STS_RUNNING 0x01       // update started
+#define BOOT_STS_COMPLETE 0x02      // all pages received
+#define BOOT_STS_CRCERR 0x04        // image crc did not match on finish
+
+#ifndef BOOT_NATIVE
+#include <avr/boot.h>
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+
+#define BOOT_LOCAL
+
+static inline void boot_uart_init(void)
+{
+    DDRD |= (1 << PD2) | (1 << PD1); // BUS_DIR & TX is OUTPUT
+    UBRRH = (BOOT_UBRR >> 8);
+    UBRRL = BOOT_UBRR;
+    UCSRB = (1 << TXEN) | (1 << RXEN);
+    UCSRC = (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); // 8bit data format
+}
+
+static inline uint8_t boot_uart_read(void)
+{
+    while (!(UCSRA & (1 << RXC)))
+        ; // wait while data is being received
+    return UDR;
+}
+
+static inline void boot_uart_write(uint8_t data)
+{
+    PORTD |= (1 << PD2); // set transciever to transmitt
+    UCSRA = (1 << TXC);  // clear transmit Complete bit
+    UDR = data;
+    while (!(UCSRA & (1 << TXC)))
+        ;
+    PORTD &= ~(1 << PD2); // set transciever to receive
+}
+
+static inline uint8_t boot_eeprom_read(uint16_t address)
+{
+    return eeprom_read_byte((const uint8_t *)address);
+}
+
+static inline void boot_eeprom_write(uint16_t address, uint8_t data)
+{
+    eeprom_update_byte((uint8_t *)address, data);
+}
+
+static inline uint8_t boot_flash_read(uint16_t address)
+{
+    return pgm_read_byte(address);
+}
+
+// erase and program one page of application section
+static inline void boot_flash_page(uint16_t address, uint8_t *data)
+{
+    boot_page_erase_safe(address);
+    for (uint8_t i = 0; i < BOOT_PAGESIZE; i += 2)
+    {
+        boot_page_fill_safe(address + i, data[i] | (data[i + 1] << 8));
+    }
+    boot_page_write_safe(address);
+    boot_rww_enable_safe();
+}
+
+static inline void boot_delay_slot(void)
+{
+    _delay_ms(BOOT_SLOT_MS);
+}
+
+// jump to application reset vector
+static inline void boot_start_app(void)
+{
+    UCSRB = 0; // release uart, application initializes it again
+    ((void (*)(void))0x0000)();
+}
+
+#else // BOOT_NATIVE
+
+// each emulated module runs in its own thread
+#define BOOT_LOCAL __thread
+
+void boot_uart_init(void);
+uint8_t boot_uart_read(void);
+void boot_uart_write(uint8_t data);
+uint8_t boot_eeprom_read(uint16_t address);
+void boot_eeprom_write(uint16_t address, uint8_t data);
+uint8_t boot_flash_read(uint16_t address);
+void boot_flash_page(uint16_t address, uint8_t *data);
+void boot_delay_slot(void);
+void boot_start_app(void);
+
+#endif // BOOT_NATIVE
+
+int boot_main(void);
@@ -0,0 +1,258 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Cycle budget benchmark. Runs the bench build of the firmware (HAL_BENCH) in
+ * simavr and measures the cycles between the rising and falling edge of the
+ * bench pins:
+ *   PB0: TIMER1_COMPA ISR
+ *   PB1: command execution in readCommand, per opcode
+ * The drum and home magnet are simulated from the motor outputs, the supply
+ * voltage is fed into ADC7 and frames are sent at the configured baud rate.
+ *
+ * Usage: isrbench <firmware.elf> [OCR1A] [baud]
+ * Returns 1 if the worst case ISR does not fit into the tick period or into
+ * the time the UART can buffer received bytes.
+ */
+
+#include <simavr/avr_adc.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_STEPS_PER_REV 2025 // steps per drum revolution
+#define BENCH_MAGNET_STEPS 30    // steps the home sensor is active
+#define BENCH_SUPPLY_MV 4000     // voltage at ADC7 (Aref = 5V)
+#define BENCH_START_S 8.0        // first frame after homing is done
+#define BENCH_FRAME_GAP_S 0.6    // gap between frames, longer than longest command
+#define BENCH_ROUNDS 3           // each frame is sent this often
+#define BENCH_UART_FIFO 2        // bytes buffered by the ATmega8 uart
+
+struct bench_stats
+{
+    avr_cycle_count_t start;
+    avr_cycle_count_t min;
+    avr_cycle_count_t max;
+    avr_cycle_count_t sum;
+    uint32_t count;
+};
+
+struct bench_frame
+{
+    const char *name;
+    uint8_t length;
+    uint8_t payload[64];
+    struct bench_stats stats;
+};
+
+// frames to module address 0, cover all command paths with bounded execution time
+static struct bench_frame frames[] = {
+    {"ping", 1, {0xFE}},
+    {"status", 1, {0xF8}},
+    {"status ext", 2, {0xFA, 0x00}},
+    {"error history", 2, {0xF9, 0x00}},
+    {"read eeprom", 1, {0xF0}},
+    {"read flapcal", 1, {0xF2}},
+    {"display", 2, {0x10, 0x05}},
+    {"display full", 2, {0x11, 0x07}},
+    {"stage", 2, {0x12, 0x09}},
+    {"display at", 7, {0x16, 0x03, 0x00, 0x00, 0x00, 0x10, 0x00}},
+    {"enqueue 8",
+     26,
+     {0x17, 0x08, 1, 0, 10, 2, 0, 10, 3, 0, 10, 4, 0, 10, 5, 0, 10, 6, 0, 10, 7, 0, 10, 8, 0, 10}},
+    {"seq display", 4, {0x41, 0x01, 0x10, 0x04}},
+    {"multi", 11, {0x40, 0x01, 0x21, 0x02, 0x10, 0x07, 0x01, 0xF8, 0x02, 0xFA, 0x00}},
+    {"write flapcal 8", 11, {0xF3, 0x00, 0x08, 0, 0, 0, 0, 0, 0, 0, 0}},
+};
+#define BENCH_FRAMES (sizeof(frames) / sizeof(frames[0]))
+
+static avr_t *avr;
+static struct bench_stats isr_stats;
+static struct bench_frame *current_frame = NULL;
+static avr_irq_t *home_irq;
+static uint32_t motor_steps = 0;
+static uint32_t last_phases = 0;
+
+static void stats_begin(struct bench_stats *stats)
+{
+    stats->start = avr->cycle;
+}
+
+static void stats_end(struct bench_stats *stats)
+{
+    avr_cycle_count_t cycles = avr->cycle - stats->start;
+    if (stats->count == 0 || cycles < stats->min)
+    {
+        stats->min = cycles;
+    }
+    if (cycles > stats->max)
+    {
+        stats->max = cycles;
+    }
+    stats->sum += cycles;
+    stats->count++;
+}
+
+static void isr_pin_cb(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)param;
+    value ? stats_begin(&isr_stats) : stats_end(&isr_stats);
+}
+
+static void cmd_pin_cb(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)param;
+    if (current_frame == NULL)
+    {
+        return;
+    }
+    value ? stats_begin(&current_frame->stats) : stats_end(&current_frame->stats);
+}
+
+// drum simulation: every new motor phase is one step
+static void motor_cb(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    (void)irq;
+    (void)param;
+    value &= 0x0F;
+    if (value == 0 || value == last_phases)
+    {
+        return;
+    }
+    last_phases = value;
+    motor_steps++;
+    uint32_t pos = motor_steps % BENCH_STEPS_PER_REV;
+    avr_raise_irq(home_irq, pos < BENCH_MAGNET_STEPS ? 0 : 1);
+}
+
+static void print_stats(const char *name, struct bench_stats *stats)
+{
+    if (stats->count == 0)
+    {
+        printf("  %-16s no samples\n", name);
+        return;
+    }
+    printf("  %-16s n=%-6u min=%-8llu avg=%-8llu max=%-8llu\n", name, stats->count,
+           (unsigned long long)stats->min, (unsigned long long)(stats->sum / stats->count),
+           (unsigned long long)stats->max);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <firmware.elf> [OCR1A] [baud]\n", argv[0]);
+        return 2;
+    }
+    uint32_t ocr1a = argc > 2 ? strtoul(argv[2], NULL, 0) : 580;
+    uint32_t baud = argc > 3 ? strtoul(argv[3], NULL, 0) : 19200;
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0)
+    {
+        fprintf(stderr, "cannot read firmware %s\n", argv[1]);
+        return 2;
+    }
+    avr = avr_make_mcu_by_name("atmega8");
+    if (avr == NULL)
+    {
+        fprintf(stderr, "simavr has no atmega8 core\n");
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = 16000000;
+    avr->vcc = avr->avcc = avr->aref = 5000;
+
+    // bench pins
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 0), isr_pin_cb, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), 1), cmd_pin_cb, NULL);
+    // drum, home sensor and supply voltage
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), IOPORT_IRQ_PIN_ALL), motor_cb, NULL);
+    home_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3);
+    avr_raise_irq(home_irq, 1);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC7), BENCH_SUPPLY_MV);
+    // uart: no output to stdout
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    avr_irq_t *uart_in = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+
+    avr_cycle_count_t byte_cycles = (avr->frequency * 10) / baud;
+    avr_cycle_count_t gap_cycles = (avr_cycle_count_t)(BENCH_FRAME_GAP_S * avr->frequency);
+    avr_cycle_count_t next_frame = (avr_cycle_count_t)(BENCH_START_S * avr->frequency);
+    avr_cycle_count_t next_byte = 0;
+    uint8_t tx[80];
+    uint8_t tx_len = 0;
+    uint8_t tx_pos = 0;
+    uint32_t sent = 0;
+
+    printf("running %s: OCR1A=%u, %u baud\n", argv[1], ocr1a, baud);
+    while (sent < BENCH_FRAMES * BENCH_ROUNDS || tx_pos < tx_len || avr->cycle < next_frame)
+    {
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed)
+        {
+            fprintf(stderr, "firmware stopped at cycle %llu\n", (unsigned long long)avr->cycle);
+            return 2;
+        }
+        if (tx_pos < tx_len && avr->cycle >= next_byte)
+        { // send next byte of frame
+            avr_raise_irq(uart_in, tx[tx_pos++]);
+            next_byte = avr->cycle + byte_cycles;
+        }
+        else if (tx_pos >= tx_len && sent < BENCH_FRAMES * BENCH_ROUNDS && avr->cycle >= next_frame)
+        { // assemble next frame
+            current_frame = &frames[sent % BENCH_FRAMES];
+            tx_len = 0;
+            tx[tx_len++] = '+';
+            tx[tx_len++] = 0x00;
+            tx[tx_len++] = current_frame->length + 3;
+            tx[tx_len++] = 0x00; // address 0
+            tx[tx_len++] = 0x00;
+            memcpy(tx + tx_len, current_frame->payload, current_frame->length);
+            tx_len += current_frame->length;
+            tx[tx_len++] = '$';
+            tx_pos = 0;
+            next_byte = avr->cycle;
+            next_frame = avr->cycle + gap_cycles;
+            sent++;
+        }
+    }
+
+    avr_cycle_count_t isr_budget = (avr_cycle_count_t)(ocr1a + 1) * 64;
+    avr_cycle_count_t rx_budget = byte_cycles * BENCH_UART_FIFO;
+    printf("\nTIMER1_COMPA ISR (cycles, without entry/exit):\n");
+    print_stats("step tick", &isr_stats);
+    printf("\ncommand execution (cycles):\n");
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        print_stats(frames[i].name, &frames[i].stats);
+    }
+    printf("\nbudget:\n");
+    printf("  tick period      %llu cycles, worst case ISR uses %.1f%%\n", (unsigned long long)isr_budget,
+           100.0 * isr_stats.max / isr_budget);
+    printf("  uart buffer      %llu cycles (%u bytes), worst case ISR uses %.1f%%\n",
+           (unsigned long long)rx_budget, BENCH_UART_FIFO, 100.0 * isr_stats.max / rx_budget);
+    printf("  motor steps      %u\n", motor_steps);
+    if (isr_stats.count == 0 || isr_stats.max >= isr_budget || isr_stats.max >= rx_budget)
+    {
+        printf("FAIL: ISR does not fit into cycle budget\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Simulated hardware for the native build (HAL_NATIVE). The state is exposed
+ * through hal_native_* variables and functions, so host programs can drive
+ * the firmware: push bus bytes, move the home magnet, set the supply voltage
+ * and call the interrupt service routines.
+ */
+
+#include "hal_native.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint8_t hal_native_irq = 0;           // 1 = interrupts enabled
+uint8_t hal_native_motor = 0;         // motor phases (PC0-PC3)
+uint8_t hal_native_home = 1;          // home sensor pin level. 0 = magnet
+uint16_t hal_native_adc = 800;        // ADC reading of supply voltage
+uint8_t hal_native_wdrf = 0;          // watchdog reset flag
+uint8_t hal_native_eeprom_irq = 0;    // EE_RDY interrupt enabled
+uint8_t hal_native_bus_tx = 0;        // transceiver direction
+uint8_t hal_native_mpcm = 0;          // multi-processor communication mode
+uint8_t hal_native_eeprom[HAL_NATIVE_EEPROM_SIZE];
+double hal_native_delay_total = 0;    // sum of all delays in ms
+jmp_buf *hal_native_reset_jmp = NULL; // target of hal_reset, exit if NULL
+
+// bus buffers
+static char rx_buffer[HAL_NATIVE_BUS_BUFFER];
+static uint16_t rx_head = 0;
+static uint16_t rx_tail = 0;
+static char tx_buffer[HAL_NATIVE_BUS_BUFFER];
+static uint16_t tx_len = 0;
+
+// reset simulated hardware to power on state
+void hal_native_init(void)
+{
+    hal_native_irq = 0;
+    hal_native_motor = 0;
+    hal_native_home = 1;
+    hal_native_adc = 800;
+    hal_native_wdrf = 0;
+    hal_native_eeprom_irq = 0;
+    hal_native_bus_tx = 0;
+    hal_native_mpcm = 0;
+    hal_native_delay_total = 0;
+    memset(hal_native_eeprom, 0xFF, sizeof(hal_native_eeprom));
+    rx_head = rx_tail = tx_len = 0;
+}
+
+// append bytes to receive buffer. returns -1 if buffer is full
+int hal_native_rx_push(const char *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t next = (rx_head + 1) % HAL_NATIVE_BUS_BUFFER;
+        if (next == rx_tail)
+        {
+            return -1;
+        }
+        rx_buffer[rx_head] = data[i];
+        rx_head = next;
+    }
+    return 0;
+}
+
+uint16_t hal_native_rx_pending(void)
+{
+    return (rx_head + HAL_NATIVE_BUS_BUFFER - rx_tail) % HAL_NATIVE_BUS_BUFFER;
+}
+
+// copy transmitted bytes and clear transmit buffer. returns amount of bytes
+uint16_t hal_native_tx_pop(char *data, uint16_t length)
+{
+    uint16_t count = tx_len < length ? tx_len : length;
+    memcpy(data, tx_buffer, count);
+    tx_len = 0;
+    return count;
+}
+
+// run EE_RDY interrupt until all pending eeprom writes are done
+void hal_native_eeprom_flush(void)
+{
+    while (hal_native_eeprom_irq)
+    {
+        hal_isr_EE_RDY();
+    }
+}
+
+void hal_bench_init(void)
+{
+}
+
+void hal_irq_disable(void)
+{
+    hal_native_irq = 0;
+}
+
+void hal_irq_enable(void)
+{
+    hal_native_irq = 1;
+}
+
+uint8_t hal_irq_save(void)
+{
+    uint8_t state = hal_native_irq;
+    hal_native_irq = 0;
+    return state;
+}
+
+void hal_irq_restore(uint8_t sreg)
+{
+    hal_native_irq = sreg;
+}
+
+void hal_delay_ms(double ms)
+{
+    hal_native_delay_total += ms;
+}
+
+uint8_t hal_wdt_reset(void)
+{
+    uint8_t wdrf = hal_native_wdrf;
+    hal_native_wdrf = 0;
+    return wdrf;
+}
+
+void hal_wdt_disable(void)
+{
+}
+
+void hal_reset(void)
+{
+    hal_native_wdrf = 1;
+    if (hal_native_reset_jmp != NULL)
+    {
+        longjmp(*hal_native_reset_jmp, 1);
+    }
+    exit(0);
+}
+
+void hal_motor_init(void)
+{
+    hal_native_motor = 0;
+}
+
+void hal_motor_out(uint8_t phases)
+{
+    hal_native_motor = phases;
+}
+
+void hal_home_init(void)
+{
+}
+
+uint8_t hal_home_pin(void)
+{
+    return hal_native_home;
+}
+
+void hal_adc_init(void)
+{
+}
+
+uint16_t hal_adc_read(void)
+{
+    return hal_native_adc;
+}
+
+void hal_timer_init(uint16_t top)
+{
+    (void)top;
+}
+
+uint8_t hal_eeprom_read(uint16_t address)
+{
+    return hal_native_eeprom[address % HAL_NATIVE_EEPROM_SIZE];
+}
+
+void hal_eeprom_write(uint16_t address, uint8_t data)
+{
+    hal_native_eeprom[address % HAL_NATIVE_EEPROM_SIZE] = data;
+}
+
+void hal_eeprom_irq(uint8_t enable)
+{
+    hal_native_eeprom_irq = enable;
+}
+
+void hal_uart_init(uint16_t ubrr)
+{
+    (void)ubrr;
+}
+
+void hal_bus_dir(uint8_t transmit)
+{
+    hal_native_bus_tx = transmit;
+}
+
+void hal_uart_write(char data)
+{
+    if (tx_len < HAL_NATIVE_BUS_BUFFER)
+    {
+        tx_buffer[tx_len++] = data;
+    }
+}
+
+void hal_uart_flush(void)
+{
+}
+
+// the firmware blocks until a byte is received. On the host there is nobody
+// to send it, so reading from an empty buffer is a fault of the caller
+char hal_uart_read(void)
+{
+    if (rx_head == rx_tail)
+    {
+        fprintf(stderr, "hal_native: read from empty bus buffer\n");
+        abort();
+    }
+    char data = rx_buffer[rx_tail];
+    rx_tail = (rx_tail + 1) % HAL_NATIVE_BUS_BUFFER;
+    return data;
+}
+
+void hal_uart_mpcm(uint8_t enable)
+{
+    hal_native_mpcm = enable;
+}
@@ -0,0 +1,42 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+#pragma once
+#include "hal.h"
+#include <setjmp.h>
+
+#define HAL_NATIVE_EEPROM_SIZE 512 // ATmega8 eeprom size
+#define HAL_NATIVE_BUS_BUFFER 512  // size of simulated bus buffers
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+extern uint8_t hal_native_irq;
+extern uint8_t hal_native_motor;
+extern uint8_t hal_native_home;
+extern uint16_t hal_native_adc;
+extern uint8_t hal_native_wdrf;
+extern uint8_t hal_native_eeprom_irq;
+extern uint8_t hal_native_bus_tx;
+extern uint8_t hal_native_mpcm;
+extern uint8_t hal_native_eeprom[HAL_NATIVE_EEPROM_SIZE];
+extern double hal_native_delay_total;
+extern jmp_buf *hal_native_reset_jmp;
+
+void hal_native_init(void);
+int hal_native_rx_push(const char *data, uint16_t length);
+uint16_t hal_native_rx_pending(void);
+uint16_t hal_native_tx_pop(char *data, uint16_t length);
+void hal_native_eeprom_flush(void);
+
+// firmware entry points (main is renamed to fw_main in the native build)
+int fw_main(void);
+void readCommand(void);
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -8,11 +8,7 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <avr/io.h>
-#include <avr/wdt.h>
-#include <avr/interrupt.h>
-#include <util/delay.h>
-#include <avr/iom8.h>
+#include "hal.h"
 
 
 // I/O Pin definition
@@ -31,18 +27,47 @@
 #define CONF_ADDR_OKAY 0x0004
 #define CONF_ADDR_ADDR 0x0000
 #define CONF_ADDR_OFFSET 0x0002
+#define CONF_ADDR_FLAPCAL_OKAY 0x003F   // marks valid per-flap calibration table
+#define CONF_ADDR_FLAPCAL 0x0040        // per-flap calibration table (int8 per flap)
+#define CONF_ADDR_GROUPS_OKAY 0x007F    // marks valid group table
+#define CONF_ADDR_GROUPS 0x0080         // group addresses (uint16, LSB first, see PROTO_GROUPS)
+#define CONF_ADDR_BOOT 0x01FF           // bootloader state, 0x00 = stay in bootloader (see bootloader/)
+#define CONF_CONST_BOOT (uint8_t)0x00
 
 // Protocol definitions
 #define PROTO_MAXPKGLEN 64          // maximum size of package in bytes
+#define PROTO_MAXRESPLEN 48         // maximum response size of a single command
+#define PROTO_ADDR_BROADCAST 0xFFFE // frames to this address are processed by all nodes
+#define PROTO_ADDR_GROUP_MIN 0xFF00 // frames to group addresses are processed by all members
+#define PROTO_ADDR_GROUP_MAX 0xFFFD
+#define PROTO_GROUPS 8              // max. groups per node
+#define PROTO_SEQ_HISTORY 16        // amount of sequence numbers tracked
+#define PROTO_SEQ_SLOT_MS 10        // response slot length for sequence state query
 
 // Command Bytes
 #define CMDB_SETVAL (uint8_t)0x10   // Set display value
 #define CMDB_SETVALR (uint8_t)0x11  // Set display value and do a full rotation 
+#define CMDB_STAGE (uint8_t)0x12    // Stage display value, wait for commit
+#define CMDB_STAGER (uint8_t)0x13   // Stage display value with full rotation, wait for commit
+#define CMDB_COMMIT (uint8_t)0x14   // Apply staged display value (broadcast)
+#define CMDB_SYNC (uint8_t)0x15     // Set tick counter (broadcast)
+#define CMDB_SETVALAT (uint8_t)0x16 // Set display value at given tick
+#define CMDB_ENQUEUE (uint8_t)0x17  // Append flaps with dwell times to sequence queue
+#define CMDB_MULTI (uint8_t)0x40    // Multiple commands in one frame
+#define CMDB_SEQ (uint8_t)0x41      // Command with sequence number
+#define CMDB_SEQQUERY (uint8_t)0x42 // Query applied sequence numbers (broadcast)
 #define CMDB_EEPROMR (uint8_t)0xF0  // Read EEPROM
 #define CMDB_EEPROMW (uint8_t)0xF1  // Write EEPROM
+#define CMDB_FLAPCALR (uint8_t)0xF2 // Read per-flap calibration table
+#define CMDB_FLAPCALW (uint8_t)0xF3 // Write per-flap calibration table
+#define CMDB_GROUPR (uint8_t)0xF4   // Read group table
+#define CMDB_GROUPW (uint8_t)0xF5   // Write group table
 #define CMDB_GSTS (uint8_t)0xF8     // Get status
+#define CMDB_GERR (uint8_t)0xF9     // Get home error history
+#define CMDB_GSTSX (uint8_t)0xFA    // Get extended status with voltage statistics
 #define CMDB_PING (uint8_t)0xFE     // Ping
 #define CMDB_RESET (uint8_t)0x30    // Reset device
+#define CMDB_BOOT (uint8_t)0x31     // Reset into bootloader for firmware update
 #define CMDB_PWRON (uint8_t)0x21    // Power motor on
 #define CMDB_RPWROFF (uint8_t)0x20  // Poer motor off
 
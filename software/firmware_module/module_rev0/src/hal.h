@@ -0,0 +1,297 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Hardware abstraction layer. All register accesses of the firmware are done
+ * here. On the target, all functions are inlined and compile to the same
+ * register accesses as before. With HAL_NATIVE the sources build on the host
+ * against the simulated hardware in native/hal_native.c.
+ */
+
+#pragma once
+#include <stdint.h>
+
+// bench build: toggle PORTB pins around measured code paths (see bench/isrbench.c)
+#define HAL_BENCH_ISR 0 // PB0: TIMER1_COMPA ISR
+#define HAL_BENCH_CMD 1 // PB1: command execution in readCommand
+
+#ifndef HAL_NATIVE
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/iom8.h>
+#include <avr/wdt.h>
+#include <util/delay.h>
+
+#define HAL_ISR(vect) ISR(vect##_vect)
+#define HAL_NOINIT __attribute__((section(".noinit")))
+
+#ifdef HAL_BENCH
+#define HAL_BENCH_BEGIN(ch) (PORTB |= (1 << (ch)))
+#define HAL_BENCH_END(ch) (PORTB &= ~(1 << (ch)))
+#else
+#define HAL_BENCH_BEGIN(ch)
+#define HAL_BENCH_END(ch)
+#endif
+
+static inline void hal_bench_init(void)
+{
+#ifdef HAL_BENCH
+    DDRB |= (1 << HAL_BENCH_ISR) | (1 << HAL_BENCH_CMD);
+    PORTB &= ~((1 << HAL_BENCH_ISR) | (1 << HAL_BENCH_CMD));
+#endif
+}
+
+// save interrupt state and disable interrupts
+static inline uint8_t hal_irq_save(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    return sreg;
+}
+
+static inline void hal_irq_restore(uint8_t sreg)
+{
+    SREG = sreg;
+}
+
+// returns 1 if last reset was caused by the watchdog. clears reset flags
+static inline uint8_t hal_wdt_reset(void)
+{
+    uint8_t wdrf = (MCUCSR & (1 << WDRF)) ? 1 : 0;
+    MCUCSR = 0;
+    return wdrf;
+}
+
+static inline void hal_wdt_disable(void)
+{
+    wdt_disable();
+}
+
+// reset controller by watchdog
+static inline void hal_reset(void)
+{
+    wdt_enable(WDTO_15MS);
+    for (;;)
+    {
+    }
+}
+
+// motor driver on PC0-PC3
+static inline void hal_motor_init(void)
+{
+    DDRC = 0x0F;  // set all pins as outputs
+    PORTC = 0x00; // set all to LOW
+}
+
+static inline void hal_motor_out(uint8_t phases)
+{
+    PORTC = phases;
+}
+
+// home sensor on PD3 (INT1)
+static inline void hal_home_init(void)
+{
+    DDRD &= ~(1 << PD3); // PD3 is input
+    PORTD |= (1 << PD3); // PD3 pullup
+
+    // setup INT1 (PD3) for home sensor
+    MCUCR = (MCUCR & ~((1 << ISC11) | (1 << ISC10))) | (1 << ISC11); // falling edge
+    GIFR = (1 << INTF1);                                             // clear pending edge
+    GICR |= (1 << INT1);                                             // enable INT1
+}
+
+// returns level of home sensor pin. 0 = magnet detected
+static inline uint8_t hal_home_pin(void)
+{
+    return (PIND & (1 << PD3)) > 0 ? 1 : 0;
+}
+
+// supply voltage on ADC7
+static inline void hal_adc_init(void)
+{
+    ADMUX = 0x07;                                      // Aref, ADC7
+    ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADPS1); // Enable ADC, Start first
+                                                       // reading No freerunning, 8MHz
+    while ((ADCSRA & (1 << ADSC)) > 0)
+    {
+    };
+    // wait until first reading is complete,
+    // to avoid error flag on first tick!
+}
+
+// return last reading and trigger next one (non blocking)
+static inline uint16_t hal_adc_read(void)
+{
+    uint16_t value = ADC;  // read last measurement
+    ADMUX = 0x07;          // select ADC7
+    ADCSRA |= (1 << ADSC); // trigger next reading
+    return value;
+}
+
+// timer 1 in CTC mode, prescaler 64, calls TIMER1_COMPA ISR
+static inline void hal_timer_init(uint16_t top)
+{
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10); // CTC und Prescaler 64
+    OCR1A = top;
+    TIMSK = 1 << OCIE1A; // Timerinterrupts aktivieren
+}
+
+// eeprom access. Caller must make sure that no interrupt accesses the eeprom
+static inline uint8_t hal_eeprom_read(uint16_t address)
+{
+    while (EECR & (1 << EEWE))
+        ; // wait until previous write is done
+    EEAR = address;
+    EECR |= (1 << EERE); // read one
+    return EEDR;
+}
+
+static inline void hal_eeprom_write(uint16_t address, uint8_t data)
+{
+    while (EECR & (1 << EEWE))
+        ; // wait until previous write is done
+    EEAR = address;
+    EEDR = data;
+    EECR |= (1 << EEMWE); // enable Master Write Enable
+    EECR |= (1 << EEWE);  // write one
+}
+
+// enable or disable EE_RDY interrupt
+static inline void hal_eeprom_irq(uint8_t enable)
+{
+    if (enable)
+    {
+        EECR |= (1 << EERIE);
+    }
+    else
+    {
+        EECR &= ~(1 << EERIE);
+    }
+}
+
+// uart and bus direction pin (PD2)
+static inline void hal_uart_init(uint16_t ubrr)
+{
+    // init I/O
+    DDRD &= ~(1 << PD0);             // BUS_DIR & TX is OUTPUT
+    DDRD |= (1 << PD2) | (1 << PD1); // BUS_DIR & TX is OUTPUT
+    PORTD &= 0x07;                   // clear PD0-PD4
+    // init UART
+    UBRRH = (ubrr >> 8);
+    UBRRL = ubrr;                                        // set baud rate
+    UCSRB |= (1 << TXEN) | (1 << RXEN);                  // enable receiver and transmitter
+    UCSRC |= (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); // 8bit data format
+#ifdef SFBUS_MPCM
+    UCSRB |= (1 << UCSZ2); // 9bit data format, 9th bit marks start of frame
+#endif
+}
+
+// set transceiver direction. 1 = transmit
+static inline void hal_bus_dir(uint8_t transmit)
+{
+    if (transmit)
+    {
+        PORTD |= (1 << PD2);
+    }
+    else
+    {
+        PORTD &= ~(1 << PD2);
+    }
+}
+
+// write byte to uart. Clears transmit complete flag, keeps MPCM
+static inline void hal_uart_write(char data)
+{
+    while (!(UCSRA & (1 << UDRE)))
+        ; // wait until buffer is empty
+    UCSRA = (UCSRA & (1 << MPCM)) | (1 << TXC); // clear transmit Complete bit
+    UDR = data;
+}
+
+// wait until transmission is complete
+static inline void hal_uart_flush(void)
+{
+    while (!(UCSRA & (1 << TXC)))
+    {
+    };
+}
+
+static inline char hal_uart_read(void)
+{
+    while (!(UCSRA & (1 << RXC)))
+        ; // wait while data is being received
+    return UDR;
+}
+
+// multi-processor communication mode: only receive bytes with 9th bit set
+static inline void hal_uart_mpcm(uint8_t enable)
+{
+    if (enable)
+    {
+        UCSRA |= (1 << MPCM);
+    }
+    else
+    {
+        UCSRA &= ~(1 << MPCM);
+    }
+}
+
+#else // HAL_NATIVE
+
+// pin numbers used in global.h
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+
+#define HAL_ISR(vect) void hal_isr_##vect(void)
+#define HAL_NOINIT
+#define HAL_BENCH_BEGIN(ch)
+#define HAL_BENCH_END(ch)
+
+#define cli() hal_irq_disable()
+#define sei() hal_irq_enable()
+#define _delay_ms(ms) hal_delay_ms(ms)
+
+// interrupt service routines, called by simulation or tests
+void hal_isr_TIMER1_COMPA(void);
+void hal_isr_INT1(void);
+void hal_isr_EE_RDY(void);
+
+void hal_bench_init(void);
+void hal_irq_disable(void);
+void hal_irq_enable(void);
+uint8_t hal_irq_save(void);
+void hal_irq_restore(uint8_t sreg);
+void hal_delay_ms(double ms);
+uint8_t hal_wdt_reset(void);
+void hal_wdt_disable(void);
+void hal_reset(void);
+void hal_motor_init(void);
+void hal_motor_out(uint8_t phases);
+void hal_home_init(void);
+uint8_t hal_home_pin(void);
+void hal_adc_init(void);
+uint16_t hal_adc_read(void);
+void hal_timer_init(uint16_t top);
+uint8_t hal_eeprom_read(uint16_t address);
+void hal_eeprom_write(uint16_t address, uint8_t data);
+void hal_eeprom_irq(uint8_t enable);
+void hal_uart_init(uint16_t ubrr);
+void hal_bus_dir(uint8_t transmit);
+void hal_uart_write(char data);
+void hal_uart_flush(void);
+char hal_uart_read(void);
+void hal_uart_mpcm(uint8_t enable);
+
+#endif // HAL_NATIVE
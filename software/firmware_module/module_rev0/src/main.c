@@ -13,32 +13,32 @@
 
 uint16_t address = 0x0000;
 uint16_t calib_offset = 0x0000;
+uint16_t groups[PROTO_GROUPS]; // group addresses, unused entries are 0xFFFF
+
+// applied sequence numbers. Bit n of seq_history is set, if seq_last - n was applied
+uint8_t seq_last = 0;
+uint16_t seq_history = 0;
 
 void eeprom_write_c(uint16_t address, uint8_t data)
 {
     // disable interrupt
     cli();
-    while (EECR & (1 << EEWE))
-        ; // wait until previous write is done
-    EEAR = address;
-    EEDR = data;
-    EECR |= (1 << EEMWE); // enable Master Write Enable
-    EECR |= (1 << EEWE);  // write one
+    hal_eeprom_write(address, data);
     sei();
 }
 
 uint8_t eeprom_read_c(uint16_t address)
 {
-    while (EECR & (1 << EEWE))
-        ; // wait until previous write is done
-    EEAR = address;
-    EECR |= (1 << EERE); // read one
-    return EEDR;
+    // disable interrupt, EE_READY interrupt may write the rotation counter
+    uint8_t sreg = hal_irq_save();
+    uint8_t data = hal_eeprom_read(address);
+    hal_irq_restore(sreg);
+    return data;
 }
 
 void initialSetup()
 {
-    wdt_disable();
+    hal_wdt_disable();
     if (eeprom_read_c(CONF_ADDR_OKAY) == CONF_CONST_OKAY)
     {
         uint8_t addrL = eeprom_read_c(CONF_ADDR_ADDR);
@@ -56,122 +56,439 @@ void initialSetup()
         eeprom_write_c(CONF_ADDR_OFFSET + 1, (uint8_t)0x00);
         eeprom_write_c(CONF_ADDR_OKAY, CONF_CONST_OKAY);
     }
+    // load group table, if present
+    for (uint8_t i = 0; i < PROTO_GROUPS; i++)
+    {
+        groups[i] = 0xFFFF;
+        if (eeprom_read_c(CONF_ADDR_GROUPS_OKAY) == CONF_CONST_OKAY)
+        {
+            uint8_t groupL = eeprom_read_c(CONF_ADDR_GROUPS + i * 2);
+            uint8_t groupH = eeprom_read_c(CONF_ADDR_GROUPS + i * 2 + 1);
+            groups[i] = groupL | (groupH << 8);
+        }
+    }
+    // load per-flap calibration, if present
+    if (eeprom_read_c(CONF_ADDR_FLAPCAL_OKAY) == CONF_CONST_OKAY)
+    {
+        for (uint8_t i = 0; i < AMOUNTFLAPS; i++)
+        {
+            mctrl_set_flapcal(i, (int8_t)eeprom_read_c(CONF_ADDR_FLAPCAL + i));
+        }
+    }
 }
 
-void readCommand()
+// send response to master. Frames sent to the broadcast address are never
+// answered, otherwise all nodes would respond at the same time.
+void sendResponse(char *msg, uint8_t length, uint8_t broadcast)
 {
-    char *payload = malloc(PROTO_MAXPKGLEN);
-    uint8_t payload_len = sfbus_recv_frame(address, payload);
-    if (payload_len > 0)
+    if (broadcast == 0)
+    {
+        _delay_ms(2);
+        sfbus_send_frame(0xFFFF, msg, length);
+    }
+}
+
+// write per-flap calibration table to response
+uint8_t writeFlapCal(char *resp)
+{
+    *resp = CMDR_ACK;
+    for (uint8_t i = 0; i < AMOUNTFLAPS; i++)
+    {
+        *(resp + 1 + i) = (char)mctrl_get_flapcal(i);
+    }
+    return AMOUNTFLAPS + 1;
+}
+
+// write group table to response, MSB first
+uint8_t writeGroups(char *resp)
+{
+    *resp = CMDR_ACK;
+    for (uint8_t i = 0; i < PROTO_GROUPS; i++)
+    {
+        *(resp + 1 + i * 2) = (char)((groups[i] >> SHIFT_1B) & 0xFF);
+        *(resp + 2 + i * 2) = (char)((groups[i] >> SHIFT_0B) & 0xFF);
+    }
+    return PROTO_GROUPS * 2 + 1;
+}
+
+// read 32 bit value, MSB first
+uint32_t readU32(char *data)
+{
+    uint32_t value = ((uint32_t)(uint8_t)*(data + 0) << SHIFT_3B);
+    value |= ((uint32_t)(uint8_t)*(data + 1) << SHIFT_2B);
+    value |= ((uint32_t)(uint8_t)*(data + 2) << SHIFT_1B);
+    value |= ((uint32_t)(uint8_t)*(data + 3) << SHIFT_0B);
+    return value;
+}
+
+// record sequence number. returns 1 if it was applied before
+uint8_t seqRecord(uint8_t seq)
+{
+    uint8_t diff = seq - seq_last;
+    if (diff == 0 && (seq_history & 1))
+    {
+        return 1; // duplicate of last command
+    }
+    uint8_t age = seq_last - seq;
+    if (seq_history == 0 || (diff >= 128 && age >= PROTO_SEQ_HISTORY))
+    { // first command after reset, or numbering of master restarted: start new history
+        seq_history = 1;
+        seq_last = seq;
+        return 0;
+    }
+    if (diff < 128)
+    { // newer sequence number
+        seq_history = diff >= PROTO_SEQ_HISTORY ? 0 : seq_history << diff;
+        seq_history |= 1;
+        seq_last = seq;
+        return 0;
+    }
+    if (seq_history & ((uint16_t)1 << age))
+    {
+        return 1;
+    }
+    seq_history |= ((uint16_t)1 << age);
+    return 0;
+}
+
+// answer sequence state query <base addr> <count> in the slot of this node
+uint8_t execSeqQuery(char *payload, char *resp)
+{
+    uint16_t base = ((uint8_t)*(payload + 1) << SHIFT_1B) | (uint8_t)*(payload + 2);
+    uint8_t count = *(payload + 3);
+    if (address < base || address - base >= count)
+    {
+        return 0;
+    }
+    for (uint16_t slot = address - base; slot > 0; slot--)
+    {
+        _delay_ms(PROTO_SEQ_SLOT_MS);
+    }
+    *resp = (char)((address >> SHIFT_1B) & 0xFF);
+    *(resp + 1) = (char)((address >> SHIFT_0B) & 0xFF);
+    *(resp + 2) = (char)seq_last;
+    *(resp + 3) = (char)((seq_history >> SHIFT_1B) & 0xFF);
+    *(resp + 4) = (char)((seq_history >> SHIFT_0B) & 0xFF);
+    return 5;
+}
+
+// execute single command with given length (opcode + arguments).
+// The response is written to resp, returns length of response (0 = no response)
+uint8_t execCommand(char *payload, uint8_t length, char *resp, uint8_t broadcast)
+{
+    // read command byte
+    uint8_t opcode = *payload;
+    // parse commands
+    if (opcode == CMDB_SETVAL)
+    {
+        // 0x1O = Set Digit
+        uint8_t targetDigit = *(payload + 1);
+        mctrl_set(targetDigit, 0);
+    }
+    else if (opcode == CMDB_SETVALR)
+    {
+        // 0x11 = Set Digit (full rotation)
+        uint8_t targetDigit = *(payload + 1);
+        mctrl_set(targetDigit, 1);
+    }
+    else if (opcode == CMDB_STAGE)
+    {
+        // 0x12 = Stage Digit, applied on commit
+        uint8_t targetDigit = *(payload + 1);
+        mctrl_stage(targetDigit, 0);
+    }
+    else if (opcode == CMDB_STAGER)
+    {
+        // 0x13 = Stage Digit (full rotation), applied on commit
+        uint8_t targetDigit = *(payload + 1);
+        mctrl_stage(targetDigit, 1);
+    }
+    else if (opcode == CMDB_COMMIT)
+    {
+        // 0x14 = Commit staged digit
+        mctrl_commit();
+    }
+    else if (opcode == CMDB_SYNC)
+    {
+        // 0x15 = Set tick counter
+        mctrl_sync(readU32(payload + 1));
+    }
+    else if (opcode == CMDB_SETVALAT)
+    {
+        // 0x16 = Set Digit at tick
+        uint8_t targetDigit = *(payload + 1);
+        uint8_t fullRotation = *(payload + 2);
+        mctrl_stage_at(targetDigit, fullRotation, readU32(payload + 3));
+    }
+    else if (opcode == CMDB_ENQUEUE)
     {
-        // read command byte
-        uint8_t opcode = *payload;
-        // parse commands
-        if (opcode == CMDB_SETVAL)
+        // 0x17 = Enqueue digits with dwell time
+        uint8_t entries = *(payload + 1);
+        char *entry = payload + 2;
+        for (uint8_t i = 0; i < entries && (entry - payload) + 3 <= length; i++)
         {
-            // 0x1O = Set Digit
-            uint8_t targetDigit = *(payload + 1);
-            mctrl_set(targetDigit, 0);
+            uint16_t dwell = ((uint8_t)*(entry + 1) << SHIFT_1B) | (uint8_t)*(entry + 2);
+            if (mctrl_enqueue(*entry, dwell) == 1)
+            {
+                break; // queue full, drop remaining entries
+            }
+            entry += 3; // invalid flaps are skipped
         }
-        else if (opcode == CMDB_SETVALR)
+    }
+    else if (opcode == CMDB_SEQ && length > 2 && *(payload + 2) != CMDB_SEQ && *(payload + 2) != CMDB_MULTI)
+    {
+        // 0x41 = Command with sequence number, duplicates are not executed
+        if (seqRecord(*(payload + 1)) == 0)
         {
-            // 0x11 = Set Digit (full rotation)
-            uint8_t targetDigit = *(payload + 1);
-            mctrl_set(targetDigit, 1);
+            return execCommand(payload + 2, length - 2, resp, broadcast);
         }
-        else if (opcode == CMDB_EEPROMR)
+    }
+    else if (opcode == CMDB_EEPROMR)
+    {
+        // 0xFO = READ EEPROM
+        uint8_t bytes = 5;
+        *resp = CMDR_ACK;
+        for (uint16_t i = 1; i < (uint16_t)bytes + 1; i++)
         {
-            // 0xFO = READ EEPROM
-            uint8_t bytes = 5;
-            char *msg = malloc(bytes + 1);
-            *msg = CMDR_ACK;
-            for (uint16_t i = 1; i < (uint16_t)bytes + 1; i++)
-            {
-                *(msg + i) = (char)eeprom_read_c(i - 1);
-            }
-            _delay_ms(2);
-            sfbus_send_frame(0xFFFF, msg, bytes + 1);
-            free(msg);
+            *(resp + i) = (char)eeprom_read_c(i - 1);
+        }
+        return bytes + 1;
+    }
+    else if (opcode == CMDB_EEPROMW && broadcast == 0)
+    {
+        // 0xF1 = WRITE EEPROM
+        eeprom_write_c(CONF_ADDR_OKAY, (char)0xFF);
+        for (uint16_t i = 0; i < 4; i++)
+        {
+            eeprom_write_c(i, *(payload + 1 + i));
+        }
+        eeprom_write_c(CONF_ADDR_OKAY, CONF_CONST_OKAY);
+        // respond with readout
+        uint8_t bytes = 5;
+        *resp = CMDR_ACK;
+        for (uint16_t i = 1; i < (uint16_t)bytes + 1; i++)
+        {
+            *(resp + i) = (char)eeprom_read_c(i - 1);
         }
-        else if (opcode == CMDB_EEPROMW)
+        // now use new addr
+        uint8_t addrL = eeprom_read_c(CONF_ADDR_ADDR);
+        uint8_t addrH = eeprom_read_c(CONF_ADDR_ADDR + 1);
+        address = addrL | (addrH << SHIFT_1B);
+        return bytes + 1;
+    }
+    else if (opcode == CMDB_FLAPCALR)
+    {
+        // 0xF2 = READ FLAP CALIBRATION
+        return writeFlapCal(resp);
+    }
+    else if (opcode == CMDB_GROUPR)
+    {
+        // 0xF4 = READ GROUP TABLE
+        return writeGroups(resp);
+    }
+    else if (opcode == CMDB_GROUPW && broadcast == 0 && length >= 2 && length >= 2 + *(payload + 1) * 2)
+    {
+        // 0xF5 = WRITE GROUP TABLE <count> <count x 16 bit group, MSB first>
+        // replaces the table, addresses outside the group range are dropped
+        uint8_t count = *(payload + 1);
+        eeprom_write_c(CONF_ADDR_GROUPS_OKAY, (char)0xFF);
+        for (uint8_t i = 0; i < PROTO_GROUPS; i++)
         {
-            // 0xF1 = WRITE EEPROM
-            eeprom_write_c(CONF_ADDR_OKAY, (char)0xFF);
-            for (uint16_t i = 0; i < 4; i++)
+            uint16_t group = 0xFFFF;
+            if (i < count)
+            {
+                group = ((uint8_t) * (payload + 2 + i * 2) << SHIFT_1B) | (uint8_t) * (payload + 3 + i * 2);
+            }
+            if (group < PROTO_ADDR_GROUP_MIN || group > PROTO_ADDR_GROUP_MAX)
             {
-                eeprom_write_c(i, *(payload + 1 + i));
+                group = 0xFFFF;
             }
-            eeprom_write_c(CONF_ADDR_OKAY, CONF_CONST_OKAY);
-            // respond with readout
-            uint8_t bytes = 5;
-            char *msg = malloc(bytes + 1);
-            *msg = CMDR_ACK;
-            for (uint16_t i = 1; i < (uint16_t)bytes + 1; i++)
+            groups[i] = group;
+            eeprom_write_c(CONF_ADDR_GROUPS + i * 2, (uint8_t)(group & 0xFF));
+            eeprom_write_c(CONF_ADDR_GROUPS + i * 2 + 1, (uint8_t)(group >> SHIFT_1B));
+        }
+        eeprom_write_c(CONF_ADDR_GROUPS_OKAY, CONF_CONST_OKAY);
+        return writeGroups(resp);
+    }
+    else if (opcode == CMDB_FLAPCALW && broadcast == 0)
+    {
+        // 0xF3 = WRITE FLAP CALIBRATION
+        uint8_t start = *(payload + 1);
+        uint8_t count = *(payload + 2);
+        if (eeprom_read_c(CONF_ADDR_FLAPCAL_OKAY) != CONF_CONST_OKAY)
+        { // initialize table
+            for (uint8_t i = 0; i < AMOUNTFLAPS; i++)
             {
-                *(msg + i) = (char)eeprom_read_c(i - 1);
+                eeprom_write_c(CONF_ADDR_FLAPCAL + i, 0x00);
             }
-            _delay_ms(2);
-            sfbus_send_frame(0xFFFF, msg, bytes + 1);
-            free(msg);
-            // now use new addr
-            uint8_t addrL = eeprom_read_c(CONF_ADDR_ADDR);
-            uint8_t addrH = eeprom_read_c(CONF_ADDR_ADDR + 1);
-            address = addrL | (addrH << SHIFT_1B);
+            eeprom_write_c(CONF_ADDR_FLAPCAL_OKAY, CONF_CONST_OKAY);
         }
-        else if (opcode == CMDB_GSTS)
+        for (uint8_t i = 0; i < count && (start + i) < AMOUNTFLAPS && 3 + i < length; i++)
         {
-            char *msg = malloc(7);
-            *msg = (char)getSts();
-            uint16_t voltage = getVoltage();
-            *(msg + 2) = (char)((voltage >> SHIFT_0B) & 0xFF);
-            *(msg + 1) = (char)((voltage >> SHIFT_1B) & 0xFF);
-            uint32_t counter = rc_getCounter();
-            *(msg + 6) = (char)((counter >> SHIFT_0B) & 0xFF);
-            *(msg + 5) = (char)((counter >> SHIFT_1B) & 0xFF);
-            *(msg + 4) = (char)((counter >> SHIFT_2B) & 0xFF);
-            *(msg + 3) = (char)((counter >> SHIFT_3B) & 0xFF);
-            _delay_ms(2);
-            sfbus_send_frame(0xFFFF, msg, 7);
-            free(msg);
+            eeprom_write_c(CONF_ADDR_FLAPCAL + start + i, *(payload + 3 + i));
+            mctrl_set_flapcal(start + i, (int8_t)*(payload + 3 + i));
+        }
+        // respond with new table
+        return writeFlapCal(resp);
+    }
+    else if (opcode == CMDB_GSTS)
+    {
+        *resp = (char)getSts();
+        uint16_t voltage = getVoltage();
+        *(resp + 2) = (char)((voltage >> SHIFT_0B) & 0xFF);
+        *(resp + 1) = (char)((voltage >> SHIFT_1B) & 0xFF);
+        uint32_t counter = rc_getCounter();
+        *(resp + 6) = (char)((counter >> SHIFT_0B) & 0xFF);
+        *(resp + 5) = (char)((counter >> SHIFT_1B) & 0xFF);
+        *(resp + 4) = (char)((counter >> SHIFT_2B) & 0xFF);
+        *(resp + 3) = (char)((counter >> SHIFT_3B) & 0xFF);
+        return 7;
+    }
+    else if (opcode == CMDB_GSTSX)
+    {
+        // 0xFA = Get extended status, optionally start new voltage window
+        uint8_t reset = length > 1 ? *(payload + 1) : 0;
+        uint16_t voltage = getVoltage();
+        uint16_t stats[4];
+        getVoltageStats(&stats[0], &stats[1], &stats[2], &stats[3], reset);
+        uint32_t counter = rc_getCounter();
+        *resp = (char)getSts();
+        *(resp + 1) = (char)((voltage >> SHIFT_1B) & 0xFF);
+        *(resp + 2) = (char)((voltage >> SHIFT_0B) & 0xFF);
+        *(resp + 3) = (char)((counter >> SHIFT_3B) & 0xFF);
+        *(resp + 4) = (char)((counter >> SHIFT_2B) & 0xFF);
+        *(resp + 5) = (char)((counter >> SHIFT_1B) & 0xFF);
+        *(resp + 6) = (char)((counter >> SHIFT_0B) & 0xFF);
+        for (uint8_t i = 0; i < 4; i++)
+        { // min, max, avg, sags
+            *(resp + 7 + i * 2) = (char)((stats[i] >> SHIFT_1B) & 0xFF);
+            *(resp + 8 + i * 2) = (char)((stats[i] >> SHIFT_0B) & 0xFF);
         }
-        else if (opcode == CMDB_PING)
+        *(resp + 15) = (char)mctrl_getFlap(); // position readback, appended for compatibility
+        return 16;
+    }
+    else if (opcode == CMDB_GERR)
+    {
+        // 0xF9 = Get home error history, optionally clear it
+        uint8_t clear = length > 1 ? *(payload + 1) : 0;
+        int16_t errors[ERROR_DATASETS];
+        uint8_t count = getErr(errors, clear);
+        *resp = CMDR_ACK;
+        *(resp + 1) = count;
+        for (uint8_t i = 0; i < count; i++)
         {
-            char msg = (char)CMDR_PING;
-            _delay_ms(2);
-            sfbus_send_frame(0xFFFF, &msg, 1);
+            *(resp + 2 + i * 2) = (char)((errors[i] >> SHIFT_1B) & 0xFF);
+            *(resp + 3 + i * 2) = (char)((errors[i] >> SHIFT_0B) & 0xFF);
         }
-        else if (opcode == CMDB_RPWROFF)
+        return 2 + count * 2;
+    }
+    else if (opcode == CMDB_PING)
+    {
+        *resp = (char)CMDR_PING;
+        return 1;
+    }
+    else if (opcode == CMDB_RPWROFF)
+    {
+        mctrl_power(0);
+    }
+    else if (opcode == CMDB_PWRON)
+    {
+        mctrl_power(1);
+    }
+    else if (opcode == CMDB_RESET)
+    {
+        do
+        {
+            cli();        // stop motor
+            mctrl_save(); // keep position for warm boot
+            hal_reset();
+        } while (0);
+    }
+    else if (opcode == CMDB_BOOT)
+    {
+        do
         {
-            mctrl_power(0);
+            cli(); // stop motor. No warm boot, new firmware may use other data
+            hal_eeprom_write(CONF_ADDR_BOOT, CONF_CONST_BOOT);
+            hal_reset();
+        } while (0);
+    }
+    else
+    {
+        // invalid opcode
+        *resp = CMDR_ERR_INVALID;
+        return 1;
+    }
+    return 0;
+}
+
+// execute records of multi-command frame: <len> <opcode> <args> ...
+// Responses are combined: <opcode> <len> <response> for each record with output
+uint8_t execMulti(char *payload, uint8_t length, char *resp, uint8_t broadcast)
+{
+    uint8_t pos = 1;
+    uint8_t resp_len = 0;
+    while (pos < length)
+    {
+        uint8_t rec_len = *(payload + pos);
+        if (rec_len == 0 || pos + 1 + rec_len > length || *(payload + pos + 1) == CMDB_MULTI)
+        {
+            break; // malformed record
         }
-        else if (opcode == CMDB_PWRON)
+        if (resp_len + 2 > PROTO_MAXPKGLEN)
+        { // no space for another full response, skip remaining records
+            break;
+        }
+        uint8_t n = execCommand(payload + pos + 1, rec_len, resp + resp_len + 2, broadcast);
+        if (n > 0)
         {
-            mctrl_power(1);
+            *(resp + resp_len) = *(payload + pos + 1);
+            *(resp + resp_len + 1) = n;
+            resp_len += n + 2;
         }
-        else if (opcode == CMDB_RESET)
+        pos += rec_len + 1;
+    }
+    return resp_len;
+}
+
+void readCommand()
+{
+    char *payload = malloc(PROTO_MAXPKGLEN);
+    uint8_t broadcast = 0;
+    uint8_t payload_len = sfbus_recv_frame(address, groups, payload, &broadcast);
+    if (payload_len > 3 && payload_len - 3 <= PROTO_MAXPKGLEN)
+    {
+        HAL_BENCH_BEGIN(HAL_BENCH_CMD);
+        char *resp = malloc(PROTO_MAXPKGLEN + PROTO_MAXRESPLEN);
+        uint8_t resp_len = 0;
+        if (*payload == CMDB_MULTI)
         {
-            do
-            {
-                wdt_enable(WDTO_15MS);
-                for (;;)
-                {
-                }
-            } while (0);
+            resp_len = execMulti(payload, payload_len - 3, resp, broadcast);
+        }
+        else if (*payload == CMDB_SEQQUERY && payload_len - 3 >= 4)
+        {
+            resp_len = execSeqQuery(payload, resp);
+            broadcast = 0; // nodes answer in their own slot
         }
         else
         {
-            // invalid opcode
-            char msg = CMDR_ERR_INVALID;
-            _delay_ms(2);
-            sfbus_send_frame(0xFFFF, &msg, 1);
+            resp_len = execCommand(payload, payload_len - 3, resp, broadcast);
+        }
+        HAL_BENCH_END(HAL_BENCH_CMD);
+        if (resp_len > 0)
+        {
+            sendResponse(resp, resp_len, broadcast);
         }
+        free(resp);
     }
     free(payload);
 }
 
 int main()
 {
+    hal_bench_init();
     initialSetup();
+    rc_init();
     rs485_init();
     mctrl_init(calib_offset);
 
@@ -24,7 +24,11 @@ uint16_t steps_since_home = 0;      // steps since last home signal
 
 // homing util variables
 uint8_t homing = 0;   // current homing step
-uint8_t lastSens = 0; // home sonsor signal from last tick
+
+// home edge captured by INT1
+volatile uint8_t home_edge = 0;     // 1 if a new home edge was captured
+volatile uint16_t home_edge_pos = 0; // absolute_pos at home edge
+volatile uint8_t stepped = 0;       // motor stepped in the current tick
 
 // counter for auto powersaving
 uint8_t ticksSinceMove = 0;
@@ -32,7 +36,35 @@ uint8_t ticksSinceMove = 0;
 // value to goto after the current is reached. 255 = NONE.
 uint8_t afterRotation = STEPS_AFTERROT;
 
-int16_t *delta_err;
+// value staged by controller, applied on commit. 255 = NONE.
+uint8_t staged_flap = STEPS_AFTERROT;
+uint8_t staged_fullRotation = 0;
+uint8_t staged_timed = 0;          // staged value is committed at staged_tick
+uint32_t staged_tick = 0;
+
+// flap sequence queue. Processed by ISR, each entry is displayed for its dwell time
+uint8_t queue_flap[MQUEUE_LEN];
+uint16_t queue_dwell[MQUEUE_LEN];
+uint8_t queue_head = 0;             // next entry to apply
+uint8_t queue_count = 0;            // entries in queue
+uint16_t dwell_ticks = 0;           // ticks to wait after current target is reached
+
+// tick counter, incremented by timer 1. Aligned by master with sync command
+volatile uint32_t ticks = 0;
+uint8_t ticks_synced = 0; // tick counter was aligned since reset
+
+// home error history. ring of the last ERROR_DATASETS deltas
+int16_t delta_err[ERROR_DATASETS];
+uint8_t delta_err_head = 0;  // next slot to write
+uint8_t delta_err_count = 0; // valid entries
+
+// warm boot data. Located in .noinit, survives a watchdog reset
+uint16_t warm_magic HAL_NOINIT;
+uint16_t warm_pos HAL_NOINIT;
+uint8_t warm_flap HAL_NOINIT;
+uint8_t warm_step HAL_NOINIT;
+uint16_t warm_check HAL_NOINIT;
+uint8_t home_verify = 0; // position was resumed, verify at next home edge
 
 // error and status flags
 uint8_t sts_flag_errorTooBig = 0; // last home signal too early or too late
@@ -45,8 +77,60 @@ uint8_t sts_flag_busy = 0;        // device is busy
 uint16_t currentVoltage = 0;      // current ADC reading
 uint8_t currentFaultReadings = 0; // ticks with faulty readings (too many will
                                   // trip pwrdwn and sts_flag_fuse)
+// voltage statistics of current window
+uint16_t voltageMin = 0xFFFF;     // lowest reading
+uint16_t voltageMax = 0;          // highest reading
+uint32_t voltageSum = 0;          // sum of readings, for average
+uint16_t voltageSamples = 0;      // amount of readings
+uint16_t voltageSags = 0;         // amount of sag events
+uint8_t voltageSagging = 0;       // voltage is currently below sag threshold
+
+// per-flap step correction, added to the position of each flap
+int8_t flap_cal[AMOUNTFLAPS];
 
 int STEPS_OFFSET = 0;
+// checksum of warm boot data
+uint16_t warmChecksum()
+{
+    return warm_magic ^ warm_pos ^ ((uint16_t)warm_flap << SHIFT_1B) ^ warm_step ^ 0xFFFF;
+}
+
+// resume position after soft reset. returns 1 if position was restored
+uint8_t mctrl_resume()
+{
+    uint8_t valid = hal_wdt_reset() && warm_magic == MWARM_MAGIC && warm_check == warmChecksum() &&
+                    warm_pos < STEPS_PER_REV && warm_flap < AMOUNTFLAPS && warm_step < 4;
+    warm_magic = 0; // use data only once
+    if (valid == 0)
+    {
+        return 0;
+    }
+    homing = 0;
+    home_verify = 1;
+    absolute_pos = warm_pos;
+    target_flap = warm_flap;
+    step_index = warm_step;
+    hal_motor_out(motor_steps[step_index]); // hold current position
+    return 1;
+}
+
+// store verified position before soft reset. must be called with interrupts disabled.
+// a home error was corrected at the home pass and failsafe only cuts the power,
+// the position is still known in both cases
+void mctrl_save()
+{
+    warm_magic = 0;
+    if (homing != 0 || sts_flag_noHome || sts_flag_fuse)
+    {
+        return; // position is not verified, search home after reset
+    }
+    warm_pos = absolute_pos;
+    warm_flap = afterRotation < AMOUNTFLAPS ? afterRotation : target_flap;
+    warm_step = step_index;
+    warm_magic = MWARM_MAGIC;
+    warm_check = warmChecksum();
+}
+
 // initialize motor controller
 void mctrl_init(int cal_offset)
 {
@@ -55,46 +139,74 @@ void mctrl_init(int cal_offset)
     }else{
         STEPS_OFFSET = cal_offset;
     }
-    DDRC = 0x0F;  // set all pins as outputs
-    PORTC = 0x00; // set all to LOW
-
-    DDRD &= ~(1 << PD3); // PD3 is input
-    PORTD |= (1 << PD3); // PD3 pullup
-
-    // setup adc
-    ADMUX = 0x07;                                      // Aref, ADC7
-    ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADPS1); // Enable ADC, Start first
-                                                       // reading No freerunning, 8MHz
-    while ((ADCSRA & (1 << ADSC)) > 0)
-    {
-    };
-    // wait until first reading is complete,
-    // to avoid error flag on first tick!
-
+    hal_motor_init();
+    hal_home_init();
+    hal_adc_init();
     // setup timer for ISR
-    TCCR1A = 0;
-    TCCR1B = (1 << WGM12) | (1 << CS11) | (1 << CS10); // CTC und Prescaler 64
-    OCR1A = MISR_OCR1A;
-    TIMSK = 1 << OCIE1A; // Timerinterrupts aktivieren
-    homing = 1;
-    delta_err = malloc(ERROR_DATASETS * sizeof(uint16_t));
-    _delay_ms(MDELAY_STARTUP);
+    hal_timer_init(MISR_OCR1A);
+    if (mctrl_resume() == 0)
+    { // cold boot, search home
+        homing = 1;
+        _delay_ms(MDELAY_STARTUP);
+    }
     sei();
 }
 
+// position of flap in steps, including offset and per-flap correction
+static int16_t flapPos(uint8_t flap)
+{
+    int16_t pos = (flap * STEPS_PER_FLAP) + STEPS_OFFSET;
+    if (flap < AMOUNTFLAPS)
+    {
+        pos += flap_cal[flap];
+    }
+    if (pos >= STEPS_PER_REV)
+    {
+        pos -= STEPS_PER_REV;
+    }
+    else if (pos < 0)
+    {
+        pos += STEPS_PER_REV;
+    }
+    return pos;
+}
+
 // call when critical fail. Powers down motor and sets flags
 void failSafe()
 {
     sts_flag_failsafe = 1;
-    PORTC = 0x00;
+    hal_motor_out(0x00);
 }
 
 // read voltage non blocking (called every tick)
 void readVoltage()
 {
-    currentVoltage = ADC;  // read last measurement
-    ADMUX = 0x07;          // select ADC7
-    ADCSRA |= (1 << ADSC); // trigger next reading
+    currentVoltage = hal_adc_read(); // read last measurement, trigger next
+    // update statistics
+    if (currentVoltage < voltageMin)
+    {
+        voltageMin = currentVoltage;
+    }
+    if (currentVoltage > voltageMax)
+    {
+        voltageMax = currentVoltage;
+    }
+    if (voltageSamples == 0xFFFF)
+    { // keep running average when window is full
+        voltageSum >>= 1;
+        voltageSamples >>= 1;
+    }
+    voltageSum += currentVoltage;
+    voltageSamples++;
+    if (voltageSagging == 0 && currentVoltage < MVOLTAGE_SAG)
+    {
+        voltageSagging = 1;
+        voltageSags++;
+    }
+    else if (voltageSagging == 1 && currentVoltage > MVOLTAGE_SAG + MVOLTAGE_SAGHYST)
+    {
+        voltageSagging = 0;
+    }
     if (currentVoltage < MVOLTAGE_LSTOP)
     { // if voltage is too low, fuse is probably broken
         currentFaultReadings++;
@@ -106,10 +218,33 @@ void readVoltage()
     }
 }
 
+// home sensor edge. Captures position, so detection is independent of step rate
+HAL_ISR(INT1)
+{
+    // glitch filter: sensor must still be active, the drum must be turning and,
+    // after homing, the last home edge must be at least MHOME_DEBOUNCE steps ago
+    if (hal_home_pin() > 0 || stepped == 0)
+    {
+        return;
+    }
+    if (homing == 0 && steps_since_home < MHOME_DEBOUNCE)
+    {
+        return;
+    }
+    home_edge_pos = absolute_pos;
+    home_edge = 1;
+}
+
 // MAIN service routine. Called by timer 1
-ISR(TIMER1_COMPA_vect)
+static inline void mctrl_tick()
 {
+    ticks++;
+    stepped = 0; // home edges until the next tick are only valid if this tick steps
     readVoltage(); // read and check voltage
+    if (staged_timed == 1 && (int32_t)(ticks - staged_tick) >= 0)
+    { // scheduled display value is due
+        mctrl_commit();
+    }
     if (sts_flag_pwrdwn == 1 || sts_flag_failsafe == 1)
     {
         return;
@@ -122,9 +257,10 @@ ISR(TIMER1_COMPA_vect)
     }
     else if (homing == 1)
     { // Homing procedure 1. step: move out of home
-        if ((PIND & (1 << PD3)) > 0)
+        if (hal_home_pin() > 0)
         {
             homing = 2;
+            home_edge = 0; // discard edges while leaving home
         }
         else
         {
@@ -133,20 +269,25 @@ ISR(TIMER1_COMPA_vect)
     }
     else if (homing == 2)
     { // Homing procedure 2. step: find magnet
-        mctrl_step();
-        if ((PIND & (1 << PD3)) == 0)
+        if (home_edge == 1)
         {
+            home_edge = 0;
             homing = 3;
             steps_since_home = 0;
             absolute_pos = STEPS_OFFSET;
             incrementCounter();
         }
+        else
+        {
+            mctrl_step();
+        }
     }
     else if (homing == 3)
     { // Homing procedure 3. step: apply offset
         if (absolute_pos <= 0)
         {
             homing = 0;
+            home_edge = 0;                  // discard edges while applying offset
             absolute_pos = STEPS_OFFSET;    // set correct position again
         }
         mctrl_step();
@@ -154,13 +295,30 @@ ISR(TIMER1_COMPA_vect)
     }
     else
     { // when no failsafe is triggered and homing is done
-        // calculate target position
-        uint16_t target_pos = (target_flap * STEPS_PER_FLAP) + STEPS_OFFSET;
-        if (target_pos >= STEPS_PER_REV)
+        // process home transition captured by INT1
+        if (home_edge == 1)
         {
-            target_pos -= STEPS_PER_REV;
+            home_edge = 0;
+            int16_t errorDelta =
+                (int16_t)(home_edge_pos > (STEPS_PER_REV / 2) ? home_edge_pos - STEPS_PER_REV : home_edge_pos);
+            sts_flag_errorTooBig = (errorDelta > MHOME_ERRDELTA) || (errorDelta < -MHOME_ERRDELTA) ? 1 : 0;
+            if (home_verify == 1 && sts_flag_errorTooBig == 1)
+            { // resumed position was wrong, search home again
+                sts_flag_errorTooBig = 0;
+                homing = 1;
+            }
+            home_verify = 0;
+            storeErr(errorDelta);
+            // keep steps moved since the edge
+            absolute_pos = absolute_pos >= home_edge_pos ? absolute_pos - home_edge_pos
+                                                         : absolute_pos + STEPS_PER_REV - home_edge_pos;
+            steps_since_home = absolute_pos;
+            // increment rotations counter
+            incrementCounter();
         }
-        if (absolute_pos != target_pos)
+        // calculate target position
+        int16_t target_pos = flapPos(target_flap);
+        if (absolute_pos != (uint16_t)target_pos)
         {
             // if target position is not reached, move motor
             ticksSinceMove = 0;
@@ -170,27 +328,6 @@ ISR(TIMER1_COMPA_vect)
             {
                 absolute_pos -= STEPS_PER_REV;
             }
-            // detect home position
-            if ((PIND & (1 << PD3)) == 0)
-            {
-                if (lastSens == 0)
-                {
-                    // new home transition
-                    int16_t errorDelta =
-                        (int16_t)(absolute_pos > (STEPS_PER_REV / 2) ? absolute_pos - STEPS_PER_REV : absolute_pos);
-                    sts_flag_errorTooBig = (errorDelta > MHOME_ERRDELTA) || (errorDelta < -MHOME_ERRDELTA) ? 1 : 0;
-                    // storeErr(errorDelta);
-                    absolute_pos = 0;
-                    steps_since_home = 0;
-                    // increment rotations counter
-                    incrementCounter();
-                }
-                lastSens = 1;
-            }
-            else
-            {
-                lastSens = 0;
-            }
         }
         else
         { // if target position is reached
@@ -199,6 +336,17 @@ ISR(TIMER1_COMPA_vect)
                 target_flap = afterRotation;
                 afterRotation = STEPS_AFTERROT;
             }
+            else if (dwell_ticks > 0)
+            { // show current flap until dwell time has passed
+                dwell_ticks--;
+            }
+            else if (queue_count > 0)
+            { // apply next flap from sequence queue
+                target_flap = queue_flap[queue_head];
+                dwell_ticks = queue_dwell[queue_head];
+                queue_head = (queue_head + 1) % MQUEUE_LEN;
+                queue_count--;
+            }
             else if (ticksSinceMove < 2)
             { // if motor has not been moved
                 sts_flag_busy = 0;
@@ -213,22 +361,41 @@ ISR(TIMER1_COMPA_vect)
             }
         }
     }
-    rc_tick(); // process counter tick, non-blocking
 }
 
-// TODO
+HAL_ISR(TIMER1_COMPA)
+{
+    HAL_BENCH_BEGIN(HAL_BENCH_ISR);
+    mctrl_tick();
+    HAL_BENCH_END(HAL_BENCH_ISR);
+}
+
+// store home error delta in history ring (called by ISR)
 void storeErr(int16_t error)
 {
-    int16_t *delta_err_tmp = malloc(ERROR_DATASETS * sizeof(uint16_t));
-    memcpy(delta_err, delta_err_tmp + sizeof(uint16_t), ((ERROR_DATASETS - 2) * sizeof(uint16_t)));
-    memcpy(&error, delta_err_tmp, sizeof(uint16_t));
-    free(delta_err);
-    delta_err = delta_err_tmp;
+    delta_err[delta_err_head] = error;
+    delta_err_head = (delta_err_head + 1) % ERROR_DATASETS;
+    if (delta_err_count < ERROR_DATASETS)
+    {
+        delta_err_count++;
+    }
 }
-// TODO
-void getErr(int16_t *error)
+
+// copy home error history, newest first. returns amount of entries
+uint8_t getErr(int16_t *error, uint8_t clear)
 {
-    memcpy(delta_err, error, (ERROR_DATASETS * sizeof(uint16_t)));
+    cli();
+    uint8_t count = delta_err_count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        error[i] = delta_err[(delta_err_head + ERROR_DATASETS - 1 - i) % ERROR_DATASETS];
+    }
+    if (clear)
+    {
+        delta_err_count = 0;
+    }
+    sei();
+    return count;
 }
 
 // return status flag
@@ -240,23 +407,76 @@ uint8_t getSts()
     status |= sts_flag_pwrdwn << 4;        // bit 4: device powered down
     status |= sts_flag_failsafe << 5;      // bit 5: failsafe active
     status |= sts_flag_busy << 6;          // bit 6: failsafe active
-    if ((PIND & (1 << PD3)) == 0)
+    status |= (ticks_synced ^ 1) << 7;     // bit 7: tick counter not synced
+    if (hal_home_pin() == 0)
     {
         status |= (1 << 3);
     }
     return status;
 }
 
+// return flap at the measured position: the last flap position the drum passed,
+// as it only turns forward. 0xFF while homing, the position is not known yet
+uint8_t mctrl_getFlap()
+{
+    cli();
+    uint16_t pos = absolute_pos;
+    uint8_t known = homing == 0;
+    sei();
+    if (!known)
+    {
+        return 0xFF;
+    }
+    uint8_t flap = 0;
+    uint16_t passed = STEPS_PER_REV;
+    for (uint8_t i = 0; i < AMOUNTFLAPS; i++)
+    {
+        uint16_t steps = (pos + STEPS_PER_REV - flapPos(i)) % STEPS_PER_REV;
+        if (steps < passed)
+        {
+            passed = steps;
+            flap = i;
+        }
+    }
+    return flap;
+}
+
 // return voltage
 uint16_t getVoltage()
 {
     return currentVoltage;
 }
 
+// return voltage statistics of current window. Optionally start a new window
+void getVoltageStats(uint16_t *min, uint16_t *max, uint16_t *avg, uint16_t *sags, uint8_t reset)
+{
+    cli();
+    *min = voltageMin;
+    *max = voltageMax;
+    *avg = voltageSamples > 0 ? voltageSum / voltageSamples : currentVoltage;
+    *sags = voltageSags;
+    if (reset)
+    {
+        voltageMin = 0xFFFF;
+        voltageMax = 0;
+        voltageSum = 0;
+        voltageSamples = 0;
+        voltageSags = 0;
+    }
+    sei();
+}
+
 // set target flap
 void mctrl_set(uint8_t flap, uint8_t fullRotation)
 {
+    if (staged_timed == 1)
+    { // direct move replaces pending timed stage
+        staged_timed = 0;
+        staged_flap = STEPS_AFTERROT;
+    }
     sts_flag_busy = 1;
+    queue_count = 0; // new target replaces running sequence
+    dwell_ticks = 0;
     if (fullRotation == 0)
     {
         target_flap = flap;
@@ -268,6 +488,82 @@ void mctrl_set(uint8_t flap, uint8_t fullRotation)
     }
 }
 
+// stage target flap. Motor does not move until mctrl_commit is called
+void mctrl_stage(uint8_t flap, uint8_t fullRotation)
+{
+    staged_timed = 0;
+    staged_flap = flap;
+    staged_fullRotation = fullRotation;
+}
+
+// stage target flap. Is committed automatically when tick counter reaches tick
+void mctrl_stage_at(uint8_t flap, uint8_t fullRotation, uint32_t tick)
+{
+    cli();
+    staged_flap = flap;
+    staged_fullRotation = fullRotation;
+    // the target refers to the bus time, which is unknown after a reset of the module
+    staged_tick = ticks_synced ? tick : ticks;
+    staged_timed = 1;
+    sei();
+}
+
+// append flap to sequence queue. returns 1 if queue is full, 2 if flap is invalid
+uint8_t mctrl_enqueue(uint8_t flap, uint16_t dwell)
+{
+    if (flap >= AMOUNTFLAPS)
+    {
+        return 2;
+    }
+    if (queue_count >= MQUEUE_LEN)
+    {
+        return 1;
+    }
+    cli();
+    uint8_t slot = (queue_head + queue_count) % MQUEUE_LEN;
+    queue_flap[slot] = flap;
+    queue_dwell[slot] = dwell;
+    queue_count++;
+    sts_flag_busy = 1;
+    sei();
+    return 0;
+}
+
+// align tick counter with master
+void mctrl_sync(uint32_t tick)
+{
+    cli();
+    ticks = tick;
+    ticks_synced = 1;
+    sei();
+}
+
+// apply staged target flap, if any
+void mctrl_commit()
+{
+    if (staged_flap < AMOUNTFLAPS)
+    {
+        mctrl_set(staged_flap, staged_fullRotation);
+        staged_flap = STEPS_AFTERROT;
+    }
+    staged_timed = 0;
+}
+
+// set step correction for a single flap
+void mctrl_set_flapcal(uint8_t flap, int8_t steps)
+{
+    if (flap < AMOUNTFLAPS)
+    {
+        flap_cal[flap] = steps;
+    }
+}
+
+// get step correction for a single flap
+int8_t mctrl_get_flapcal(uint8_t flap)
+{
+    return flap < AMOUNTFLAPS ? flap_cal[flap] : 0;
+}
+
 // trigger home procedure
 void mctrl_home()
 {
@@ -280,23 +576,24 @@ void mctrl_power(uint8_t state)
     if (state == 0)
     {
         sts_flag_pwrdwn = 1;
-        PORTC = 0x00;
+        hal_motor_out(0x00);
     }
     else
     {
         sts_flag_pwrdwn = 0;
-        PORTC = motor_steps[step_index];
+        hal_motor_out(motor_steps[step_index]);
     }
 }
 
 // do stepper step (I/O)
 void mctrl_step()
 {
+    stepped = 1;
     step_index++;
     steps_since_home++;
     if (step_index > 3)
     {
         step_index = 0;
     }
-    PORTC = motor_steps[step_index];
+    hal_motor_out(motor_steps[step_index]);
 }
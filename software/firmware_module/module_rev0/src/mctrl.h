@@ -19,15 +19,22 @@
 #define AMOUNTFLAPS 45      // amount of flaps installed in system
 #define STEPS_AFTERROT 255  // value to goto after current target flap is reached
 #define ERROR_DATASETS 8    // length of error array
+#define MQUEUE_LEN 8        // length of flap sequence queue
 
 #define MDELAY_STARTUP 1000 // delay to wait after motor startup
+#define MWARM_MAGIC 0x5AA5  // marks valid warm boot data in .noinit section
 #define MHOME_TOLERANCE 1.5 // tolerance for intial homing procedure
 #define MHOME_ERRDELTA 30   // maximum deviation between expected home and actual home
+#define MHOME_DEBOUNCE 200  // minimum steps between two home edges (glitch filter)
 #define MVOLTAGE_FAULTRD 20 // max. amount of fault readings before flag is set
 #define MVOLTAGE_LSTOP 128  // lower voltage threshold for fuse detection
+#define MVOLTAGE_SAG 186    // voltage sag threshold (~10V), counted as sag event
+#define MVOLTAGE_SAGHYST 4  // hysteresis before next sag event is counted
 #define MPWRSVG_TICKSTOP 50 // inactive ticks before motor shutdown
 
+#ifndef MISR_OCR1A
 #define MISR_OCR1A 580      // tick timer (defines rotation speed)
+#endif
 // 450, 480 also possible ?
 
 #ifdef __cplusplus
@@ -36,11 +43,22 @@ extern "C" {
 void mctrl_init(int cal_offset);
 void mctrl_step();
 void mctrl_set(uint8_t flap, uint8_t fullRotation);
+void mctrl_stage(uint8_t flap, uint8_t fullRotation);
+void mctrl_commit();
+void mctrl_stage_at(uint8_t flap, uint8_t fullRotation, uint32_t tick);
+void mctrl_sync(uint32_t tick);
+uint8_t mctrl_enqueue(uint8_t flap, uint16_t dwell);
 
-void getErr(int16_t* error);
+void storeErr(int16_t error);
+uint8_t getErr(int16_t* error, uint8_t clear);
 uint8_t getSts();
 uint16_t getVoltage();
+uint8_t mctrl_getFlap();
+void getVoltageStats(uint16_t *min, uint16_t *max, uint16_t *avg, uint16_t *sags, uint8_t reset);
 void mctrl_power(uint8_t state);
+void mctrl_save();
+void mctrl_set_flapcal(uint8_t flap, int8_t steps);
+int8_t mctrl_get_flapcal(uint8_t flap);
 
 #ifdef __cplusplus
 }
@@ -6,62 +6,137 @@
  * https://github.com/dennis9819/splitflap_v1
  */
 
+/*
+ * Rotation counter. Each counter update is written as a new record into a ring
+ * of RC_RING_RECORDS records, so each EEPROM cell is only written every
+ * RC_RING_RECORDS home passes. Each record holds an 8-bit sequence number and a
+ * checksum. The newest valid record is the one without a valid successor
+ * (seq + 1). A record torn by a power loss fails the checksum and is skipped.
+ *
+ * Records are written byte by byte from the EE_READY interrupt, so the
+ * stepping ISR never waits for the EEPROM.
+ */
 
 #include "rcount.h"
 
-uint8_t rc_eeprom_write_c(uint16_t address, uint8_t data)
+volatile uint32_t counter = 0;          // current counter value
+uint8_t rc_slot = RC_RING_RECORDS - 1;  // slot of newest record
+uint8_t rc_seq = 0xFF;                  // sequence number of newest record
+
+// record currently being written by EE_READY interrupt
+uint8_t rc_record[RC_RECORD_LEN];
+uint8_t rc_phase = RC_RECORD_LEN;       // next byte to write. RC_RECORD_LEN = idle
+uint32_t rc_written = 0;                // counter value of record being written
+
+uint8_t rc_eeprom_read_c(uint16_t address)
 {
-    // disable interrupt
-    if (EECR & (1 << EEWE))
+    return hal_eeprom_read(address);
+}
+
+uint8_t rc_checksum(uint8_t *record)
+{
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < RC_RECORD_LEN - 1; i++)
     {
-        return 1;
+        sum += record[i];
     }
-    EEAR = address;
-    EEDR = data;
-    EECR |= (1 << EEMWE); // enable Master Write Enable
-    EECR |= (1 << EEWE);  // write one
-    return 0;
+    return ~sum;
 }
 
-uint8_t rc_eeprom_read_c(uint16_t address)
+// read record from slot. returns 1 if record is valid
+uint8_t rc_read_record(uint8_t slot, uint8_t *record)
 {
-    while (EECR & (1 << EEWE))
-        ; // wait until previous write is done
-    EEAR = address;
-    EECR |= (1 << EERE); // read one
-    return EEDR;
+    uint16_t addr = RC_RING_BASEADDR + (uint16_t)slot * RC_RECORD_LEN;
+    for (uint8_t i = 0; i < RC_RECORD_LEN; i++)
+    {
+        record[i] = rc_eeprom_read_c(addr + i);
+    }
+    return record[RC_RECORD_LEN - 1] == rc_checksum(record) ? 1 : 0;
 }
 
-uint32_t counter = (uint32_t)0xFFFFFFFF;
-uint8_t counter_phase = 5;
-void rc_tick()
+// find newest record. must be called before interrupts are enabled
+void rc_init()
 {
+    uint8_t record[RC_RECORD_LEN];
+    uint8_t next[RC_RECORD_LEN];
+    for (uint8_t slot = 0; slot < RC_RING_RECORDS; slot++)
+    {
+        if (rc_read_record(slot, record) == 0)
+        {
+            continue;
+        }
+        uint8_t next_slot = (slot + 1) % RC_RING_RECORDS;
+        if (rc_read_record(next_slot, next) == 1 && next[0] == (uint8_t)(record[0] + 1))
+        {
+            continue; // record has a successor
+        }
+        rc_slot = slot;
+        rc_seq = record[0];
+        counter = record[1];
+        counter |= ((uint32_t)record[2] << SHIFT_1B);
+        counter |= ((uint32_t)record[3] << SHIFT_2B);
+        counter |= ((uint32_t)record[4] << SHIFT_3B);
+        return;
+    }
+    // no valid record, migrate counter from legacy location
+    counter = rc_eeprom_read_c(RC_BASEADDR);
+    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 1) << SHIFT_1B);
+    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 2) << SHIFT_2B);
+    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 3) << SHIFT_3B);
     if (counter == (uint32_t)0xFFFFFFFF)
     {
-        counter = rc_getCounter();
+        counter = 0;
     }
-    if (counter_phase < 5)
+}
+
+// prepare next record and enable EE_READY interrupt. interrupts must be disabled
+void rc_start()
+{
+    rc_slot = (rc_slot + 1) % RC_RING_RECORDS;
+    rc_seq++;
+    rc_written = counter;
+    rc_record[0] = rc_seq;
+    rc_record[1] = (rc_written >> SHIFT_0B) & 0xFF;
+    rc_record[2] = (rc_written >> SHIFT_1B) & 0xFF;
+    rc_record[3] = (rc_written >> SHIFT_2B) & 0xFF;
+    rc_record[4] = (rc_written >> SHIFT_3B) & 0xFF;
+    rc_record[5] = rc_checksum(rc_record);
+    rc_phase = 0;
+    hal_eeprom_irq(1);
+}
+
+// write record byte by byte, called when EEPROM is ready
+HAL_ISR(EE_RDY)
+{
+    if (rc_phase < RC_RECORD_LEN)
     {
-        cli();
-        if (rc_eeprom_write_c(0x100 + counter_phase, ((counter >> (counter_phase * 8)) & 0xFF)) == 0)
-        {
-            counter_phase++;
-        }
-        sei();
+        hal_eeprom_write(RC_RING_BASEADDR + (uint16_t)rc_slot * RC_RECORD_LEN + rc_phase, rc_record[rc_phase]);
+        rc_phase++;
+    }
+    else if (counter != rc_written)
+    { // counter changed while writing, store new value
+        rc_start();
+    }
+    else
+    {
+        hal_eeprom_irq(0);
     }
 }
 
+// called from stepping ISR on home pass
 void incrementCounter()
 {
     counter++;
-    counter_phase = 0;
+    if (rc_phase >= RC_RECORD_LEN)
+    {
+        rc_start();
+    }
 }
 
 uint32_t rc_getCounter()
 {
-    uint32_t counter = rc_eeprom_read_c(RC_BASEADDR);
-    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 1) << SHIFT_1B);
-    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 2) << SHIFT_2B);
-    counter |= ((uint32_t)rc_eeprom_read_c(RC_BASEADDR + 3) << SHIFT_3B);
-    return counter;
+    uint8_t sreg = hal_irq_save();
+    uint32_t value = counter;
+    hal_irq_restore(sreg);
+    return value;
 }
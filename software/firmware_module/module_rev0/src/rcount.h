@@ -8,14 +8,17 @@
 
 #include "global.h"
 
-#define RC_BASEADDR 0x100
+#define RC_BASEADDR 0x100       // legacy counter location (read once for migration)
+#define RC_RING_BASEADDR 0x108  // first record of wear levelling ring
+#define RC_RECORD_LEN 6         // seq (1), counter (4), checksum (1)
+#define RC_RING_RECORDS 41      // records in ring: (0x1FF - RC_RING_BASEADDR) / RC_RECORD_LEN, 0x1FF is bootloader state
 
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
+void rc_init();
 void incrementCounter();
 uint32_t rc_getCounter();
-void rc_tick();
 #ifdef __cplusplus
 }
 #endif // __cplusplus
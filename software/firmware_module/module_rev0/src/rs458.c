@@ -10,36 +10,21 @@
 
 void rs485_init()
 {
-    // init I/O
-    DDRD &= ~(1 << PD0);             // BUS_DIR & TX is OUTPUT
-    DDRD |= (1 << PD2) | (1 << PD1); // BUS_DIR & TX is OUTPUT
-    PORTD &= 0x07;                   // clear PD0-PD4
-    // init UART
-    UBRRH = (BAUDRATE >> 8);
-    UBRRL = BAUDRATE;                                    // set baud rate
-    UCSRB |= (1 << TXEN) | (1 << RXEN);                  // enable receiver and transmitter
-    UCSRC |= (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); // 8bit data format
+    hal_uart_init(BAUDRATE);
 }
 
 void dbg(char data)
 {
-    while (!(UCSRA & (1 << UDRE)))
-        ;
-    UDR = data;
+    hal_uart_write(data);
 }
 
 
 void rs485_send_c(char data)
 {
-    PORTD |= (1 << PD2); // set transciever to transmitt
-    while (!(UCSRA & (1 << UDRE)))
-        ;               // wait until buffer is empty
-    UCSRA = (1 << TXC); // clear transmit Complete bit
-    UDR = data;
-    while (!(UCSRA & (1 << TXC)))
-    {
-    }; // wait until transmitt complete
-    PORTD &= ~(1 << PD2); // set transciever to transmitt
+    hal_bus_dir(1); // set transciever to transmitt
+    hal_uart_write(data);
+    hal_uart_flush(); // wait until transmitt complete
+    hal_bus_dir(0);   // set transciever to receive
 }
 
 void rs485_send_str(char *data)
@@ -52,17 +37,42 @@ void rs485_send_str(char *data)
 
 char rs485_recv_c()
 {
-    while (!(UCSRA & (1 << RXC)))
-        ; // wait while data is being received
-    return UDR;
+    return hal_uart_read();
+}
+
+// check if frame address is one of the groups of this node
+static uint8_t sfbus_group_member(uint16_t frm_addr, const uint16_t *groups)
+{
+    if (frm_addr < PROTO_ADDR_GROUP_MIN || frm_addr > PROTO_ADDR_GROUP_MAX)
+    {
+        return 0;
+    }
+    for (uint8_t i = 0; i < PROTO_GROUPS; i++)
+    {
+        if (groups[i] == frm_addr)
+        {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 // SFBUS Functions
-uint8_t sfbus_recv_frame(uint16_t address, char *payload)
+// receive frame for address, broadcast or a group. Broadcast and group frames
+// are never answered, broadcast is set for both
+uint8_t sfbus_recv_frame(uint16_t address, const uint16_t *groups, char *payload, uint8_t *broadcast)
 {
+#ifdef SFBUS_MPCM
+    // only receive bytes with 9th bit set. The uart drops all other bytes,
+    // so payload of frames for other nodes is never processed.
+    hal_uart_mpcm(1);
+#endif
     while (rs485_recv_c() != SFBUS_SOF_BYTE)
     {
     } // Wwait for start byte
+#ifdef SFBUS_MPCM
+    hal_uart_mpcm(0); // receive remaining frame
+#endif
 
     uint8_t frm_version = rs485_recv_c();
     if (frm_version != 0)
@@ -72,8 +82,20 @@ uint8_t sfbus_recv_frame(uint16_t address, char *payload)
     uint8_t frm_addrH = rs485_recv_c();
 
     uint16_t frm_addr = frm_addrL | (frm_addrH << SHIFT_1B);
-    if (frm_addr != address)
+    *broadcast = (frm_addr == PROTO_ADDR_BROADCAST || sfbus_group_member(frm_addr, groups)) ? 1 : 0;
+    if (frm_addr != address && *broadcast == 0)
         return 0;
+    if (frm_length < 3)
+        return 0;
+    if (frm_length - 3 > PROTO_MAXPKGLEN)
+    { // does not fit into payload buffer, e.g. a bootloader page. Skip payload and
+      // end byte, so start bytes in the payload are not taken for a frame
+        for (uint8_t i = 0; i < frm_length - 2; i++)
+        {
+            rs485_recv_c();
+        }
+        return 0;
+    }
     char *_payload = payload;
     for (uint8_t i = 0; i < (frm_length - 3); i++)
     {
@@ -82,7 +104,7 @@ uint8_t sfbus_recv_frame(uint16_t address, char *payload)
     }
 
     if (rs485_recv_c() != SFBUS_EOF_BYTE)
-        return -1;
+        return 0; // corrupted frame is dropped
     return frm_length;
 }
 
@@ -9,7 +9,9 @@
 
 #pragma once
 //#define F_CPU 16000000UL
+#ifndef UART_BAUD
 #define UART_BAUD 19200     // RS485 baud rate
+#endif
 #define BAUDRATE ((F_CPU) / (UART_BAUD * 16UL) - 1)  // set baud rate value for UBRR
 
 #define SFBUS_SOF_BYTE '+'  // Byte marks start of frame
@@ -25,7 +27,7 @@ void rs485_send_c(char data);
 void rs485_send_str(char* data);
 char rs485_recv_c(void);
 
-uint8_t sfbus_recv_frame(uint16_t address, char* payload);
+uint8_t sfbus_recv_frame(uint16_t address, const uint16_t* groups, char* payload, uint8_t* broadcast);
 void sfbus_send_frame(uint16_t address, char* payload, uint8_t length);
 
 #ifdef __cplusplus
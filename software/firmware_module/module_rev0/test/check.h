@@ -0,0 +1,30 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Checks of the native unit tests. CHECK reports a failed condition and keeps
+ * running, CHECK_RESULT prints the result of the test file and is returned by
+ * main.
+ */
+
+#pragma once
+#include <stdio.h>
+
+static int failed = 0;
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);                                                     \
+            failed = 1;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+#define CHECK_RESULT() (printf("%s: %s\n", __FILE__, failed ? "FAILED" : "OK"), failed)
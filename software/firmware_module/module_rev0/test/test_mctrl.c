@@ -0,0 +1,133 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Timed stages of the motor controller against the native HAL: tick sync,
+ * targets of an unsynced tick counter and direct moves replacing a timed stage.
+ * Warm boot data is only kept while the position is known, the flap readback
+ * follows the measured position, invalid queue entries are rejected and home
+ * edges of a stopped drum are ignored.
+ * Returns 1 if a check fails.
+ */
+
+#include "check.h"
+#include "hal_native.h"
+#include "mctrl.h"
+#include <stdio.h>
+
+extern uint8_t staged_timed;
+extern uint32_t staged_tick;
+extern uint8_t staged_flap;
+extern volatile uint32_t ticks;
+extern uint8_t ticks_synced;
+extern uint16_t warm_magic;
+extern uint8_t homing;
+extern uint8_t sts_flag_errorTooBig;
+extern uint8_t sts_flag_noHome;
+extern uint8_t sts_flag_failsafe;
+extern uint16_t absolute_pos;
+extern uint8_t queue_count;
+extern volatile uint8_t home_edge;
+extern volatile uint8_t stepped;
+
+static void testSyncFlag()
+{
+    CHECK((getSts() & 0x80) != 0);
+    mctrl_sync(1000);
+    CHECK((getSts() & 0x80) == 0);
+    CHECK(ticks == 1000);
+}
+
+static void testStageAhead()
+{
+    mctrl_sync(1000);
+    mctrl_stage_at(5, 0, 1500);
+    CHECK(staged_timed == 1 && staged_tick == 1500);
+    // target in the past is due now
+    mctrl_stage_at(5, 0, 900);
+    CHECK((int32_t)(ticks - staged_tick) >= 0);
+    // bus time unknown after a reset of the module, target is due now
+    ticks_synced = 0;
+    mctrl_stage_at(5, 0, 1500);
+    CHECK(staged_timed == 1 && staged_tick == 1000);
+    ticks_synced = 1;
+}
+
+static void testSetReplacesStage()
+{
+    mctrl_sync(1000);
+    mctrl_stage_at(5, 0, 2000);
+    mctrl_set(7, 0);
+    CHECK(staged_timed == 0);
+    CHECK(staged_flap >= AMOUNTFLAPS);
+}
+
+static void testSaveFlags()
+{
+    homing = 0;
+    sts_flag_errorTooBig = 1;
+    sts_flag_failsafe = 1;
+    mctrl_save();
+    CHECK(warm_magic == MWARM_MAGIC);
+    sts_flag_noHome = 1;
+    mctrl_save();
+    CHECK(warm_magic == 0);
+    sts_flag_noHome = 0;
+    sts_flag_errorTooBig = 0;
+    sts_flag_failsafe = 0;
+}
+
+static void testFlapReadback()
+{
+    homing = 0;
+    absolute_pos = 7 * STEPS_PER_FLAP + 3;
+    CHECK(mctrl_getFlap() == 7);
+    absolute_pos = 7 * STEPS_PER_FLAP - 1; // still before flap 7
+    CHECK(mctrl_getFlap() == 6);
+    homing = 1;
+    CHECK(mctrl_getFlap() == 0xFF);
+    homing = 0;
+}
+
+static void testEnqueueInvalid()
+{
+    uint8_t count = queue_count;
+    CHECK(mctrl_enqueue(AMOUNTFLAPS, 0) == 2);
+    CHECK(queue_count == count);
+    CHECK(mctrl_enqueue(3, 0) == 0);
+    CHECK(queue_count == count + 1);
+}
+
+static void testHomeEdgeStopped()
+{
+    homing = 2;
+    home_edge = 0;
+    hal_native_home = 0; // magnet
+    stepped = 0;
+    hal_isr_INT1();
+    CHECK(home_edge == 0);
+    stepped = 1;
+    hal_isr_INT1();
+    CHECK(home_edge == 1);
+    hal_native_home = 1;
+    home_edge = 0;
+    homing = 0;
+}
+
+int main()
+{
+    hal_native_init();
+    testSyncFlag();
+    testStageAhead();
+    testSetReplacesStage();
+    testSaveFlags();
+    testFlapReadback();
+    testEnqueueInvalid();
+    testHomeEdgeStopped();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,137 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Frame parsing of sfbus_recv_frame against the native HAL. Each case pushes
+ * raw bus bytes and checks the returned length, payload and broadcast flag.
+ * Returns 1 if a check fails.
+ */
+
+#include "check.h"
+#include "hal_native.h"
+#include "rs485.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_ADDRESS 0x1234
+#define TEST_GROUP 0xFF10
+
+static const uint16_t groups[PROTO_GROUPS] = {TEST_GROUP, 0xFFFF, 0xFFFF, 0xFFFF,
+                                              0xFFFF,     0xFFFF, 0xFFFF, 0xFFFF};
+
+// push frame with given payload to bus. frm_length is sent as is, eof replaces the end byte
+static void pushFrame(uint16_t address, const char *payload, uint8_t length, uint8_t frm_length, char eof)
+{
+    char frame[HAL_NATIVE_BUS_BUFFER];
+    uint16_t pos = 0;
+    frame[pos++] = SFBUS_SOF_BYTE;
+    frame[pos++] = 0; // protocol version
+    frame[pos++] = (char)frm_length;
+    frame[pos++] = (char)(address & 0xFF);
+    frame[pos++] = (char)((address >> 8) & 0xFF);
+    memcpy(frame + pos, payload, length);
+    pos += length;
+    frame[pos++] = eof;
+    hal_native_rx_push(frame, pos);
+}
+
+static uint8_t recv(char *payload, uint8_t *broadcast)
+{
+    memset(payload, 0, PROTO_MAXPKGLEN);
+    *broadcast = 0xAA;
+    return sfbus_recv_frame(TEST_ADDRESS, groups, payload, broadcast);
+}
+
+static void testOwnAddress()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    hal_native_init();
+    pushFrame(TEST_ADDRESS, "\x10\x05", 2, 5, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 5);
+    CHECK(broadcast == 0);
+    CHECK(memcmp(payload, "\x10\x05", 2) == 0);
+    CHECK(hal_native_rx_pending() == 0);
+}
+
+static void testBroadcast()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    hal_native_init();
+    pushFrame(PROTO_ADDR_BROADCAST, "\x21", 1, 4, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 4);
+    CHECK(broadcast == 1);
+}
+
+static void testGroups()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    hal_native_init();
+    pushFrame(TEST_GROUP, "\x21", 1, 4, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 4);
+    CHECK(broadcast == 1);
+    hal_native_init();
+    pushFrame(TEST_GROUP + 1, "\x21", 1, 4, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 0);
+}
+
+static void testOtherAddress()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    hal_native_init();
+    pushFrame(TEST_ADDRESS + 1, "\x10\x05", 2, 5, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 0);
+}
+
+static void testLength()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    // payload does not fit into buffer, e.g. a bootloader page. A frame inside
+    // its payload is skipped, the next frame is received
+    char page[PROTO_MAXPKGLEN + 1];
+    const char inner[] = {SFBUS_SOF_BYTE, 0, 5, TEST_ADDRESS & 0xFF, TEST_ADDRESS >> 8, 0x10, 0x07, SFBUS_EOF_BYTE};
+    memset(page, 0, sizeof(page));
+    memcpy(page, inner, sizeof(inner));
+    hal_native_init();
+    pushFrame(PROTO_ADDR_BROADCAST, page, sizeof(page), sizeof(page) + 3, SFBUS_EOF_BYTE);
+    pushFrame(TEST_ADDRESS, "\x10\x05", 2, 5, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 0);
+    CHECK(recv(payload, &broadcast) == 5);
+    CHECK(memcmp(payload, "\x10\x05", 2) == 0);
+    // shorter than address
+    hal_native_init();
+    pushFrame(TEST_ADDRESS, "", 0, 2, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 0);
+}
+
+static void testBadEof()
+{
+    char payload[PROTO_MAXPKGLEN];
+    uint8_t broadcast;
+    hal_native_init();
+    pushFrame(TEST_ADDRESS, "\x10\x05", 2, 5, 'x');
+    CHECK(recv(payload, &broadcast) == 0);
+    // next frame is received normally
+    pushFrame(TEST_ADDRESS, "\x10\x05", 2, 5, SFBUS_EOF_BYTE);
+    CHECK(recv(payload, &broadcast) == 5);
+}
+
+int main()
+{
+    testOwnAddress();
+    testBroadcast();
+    testGroups();
+    testOtherAddress();
+    testLength();
+    testBadEof();
+    return CHECK_RESULT();
+}
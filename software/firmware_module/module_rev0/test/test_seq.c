@@ -0,0 +1,66 @@
+/* Copyright (C) 2025 Dennis Gunia - All Rights Reserved
+ * You may use, distribute and modify this code under the
+ * terms of the  AGPL-3.0 license.
+ *
+ * https://www.dennisgunia.de
+ * https://github.com/dennis9819/splitflap_v1
+ */
+
+/*
+ * Duplicate suppression of commands with sequence number (seqRecord).
+ * Returns 1 if a check fails.
+ */
+
+#include "check.h"
+#include "hal_native.h"
+#include <stdio.h>
+
+extern uint8_t seq_last;
+extern uint16_t seq_history;
+uint8_t seqRecord(uint8_t seq);
+
+static void reset()
+{
+    seq_last = 0;
+    seq_history = 0;
+}
+
+static void testDuplicates()
+{
+    reset();
+    CHECK(seqRecord(1) == 0);
+    CHECK(seqRecord(2) == 0);
+    CHECK(seqRecord(2) == 1);
+    CHECK(seqRecord(1) == 1);
+    CHECK(seqRecord(4) == 0);
+    CHECK(seqRecord(3) == 0); // late, but not applied yet
+    CHECK(seqRecord(3) == 1);
+}
+
+static void testAfterReset()
+{
+    // numbering of master continues far ahead of the reset module
+    reset();
+    CHECK(seqRecord(200) == 0);
+    CHECK(seq_last == 200 && seq_history == 1);
+    CHECK(seqRecord(200) == 1);
+    CHECK(seqRecord(201) == 0);
+}
+
+static void testMasterRestart()
+{
+    // master starts again at 1 while the module is at 100
+    reset();
+    seqRecord(100);
+    CHECK(seqRecord(1) == 0);
+    CHECK(seq_last == 1 && seq_history == 1);
+    CHECK(seqRecord(1) == 1);
+}
+
+int main()
+{
+    testDuplicates();
+    testAfterReset();
+    testMasterRestart();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,390 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ * This section provides keyframe animations of the whole wall. Animations are
+ * uploaded once and played by the controller. The player checks every frame
+ * against bus and travel time (see devicemgr_frameDuration): a frame that
+ * cannot be in place before the next frame starts is dropped and its cells
+ * are merged into the next frame.
+ */
+
+#include "animation.h"
+#include "scheduler.h"
+#include <pthread.h>
+#include <time.h>
+
+struct SFANIM animations[SFANIM_MAX];
+struct SFANIM_PLAYER player = {-1, 0, 0, 0, 0, 0};
+int64_t playStart = 0;     // start of first frame, unix time in ms
+u_int32_t playGeneration;  // changed on every play and stop
+pthread_mutex_t animLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t animCond = PTHREAD_COND_INITIALIZER;
+pthread_t animThread;
+
+static int animation_find(const char *name)
+{
+    for (int i = 0; i < SFANIM_MAX; i++)
+    {
+        if (animations[i].frames != NULL && strcmp(animations[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void animation_free(struct SFANIM *anim)
+{
+    for (int i = 0; anim->frames != NULL && i < anim->frame_count; i++)
+    {
+        free(anim->frames[i].cells);
+    }
+    free(anim->frames);
+    anim->frames = NULL;
+}
+
+// merge cells of frame into pending, replacing cells at the same position
+static void animation_merge(struct SFANIM_PENDING *pending, struct SFANIM_FRAME *frame)
+{
+    for (int c = 0; c < frame->cell_count; c++)
+    {
+        struct SFDEVICE_CELL *cell = &frame->cells[c];
+        int i = 0;
+        while (i < pending->count && (pending->cells[i].x != cell->x || pending->cells[i].y != cell->y))
+        {
+            i++;
+        }
+        if (i == pending->count)
+        {
+            if (pending->count == pending->capacity)
+            {
+                pending->capacity = pending->capacity == 0 ? 64 : pending->capacity * 2;
+                pending->cells = realloc(pending->cells, sizeof(struct SFDEVICE_CELL) * pending->capacity);
+            }
+            pending->count++;
+        }
+        pending->cells[i] = *cell;
+    }
+}
+
+// wait until time (unix time in ms) or until player is stopped. animLock must
+// be held. returns 0 if generation changed
+static int animation_wait(int64_t until, u_int32_t generation)
+{
+    struct timespec abstime;
+    abstime.tv_sec = until / 1000;
+    abstime.tv_nsec = (until % 1000) * 1000000;
+    while (playGeneration == generation && scheduler_now_ms() < until)
+    {
+        pthread_cond_timedwait(&animCond, &animLock, &abstime);
+    }
+    return playGeneration == generation;
+}
+
+/*
+ * Play one frame. Cells of frame are merged into pending, which is printed if
+ * it can arrive before next_due. Otherwise the frame is dropped, pending is
+ * printed with the next frame. After SFANIM_MAX_DROPS drops in a row pending is
+ * printed late, so a slow display still shows every n-th frame. animLock must
+ * be held.
+ * returns 0 if player was stopped
+ */
+static int animation_frame(struct SFANIM_FRAME *frame, struct SFANIM_PENDING *pending, int fullRotation, int64_t due,
+                           int64_t next_due, int final, u_int32_t generation)
+{
+    animation_merge(pending, frame);
+    pthread_mutex_unlock(&animLock);
+    devicemgr_lock();
+    int duration = devicemgr_frameDuration(pending->cells, pending->count, fullRotation);
+    devicemgr_unlock();
+    pthread_mutex_lock(&animLock);
+    if (!animation_wait(due - duration - SFANIM_MARGIN_MS, generation))
+    {
+        return 0;
+    }
+    pthread_mutex_unlock(&animLock);
+
+    devicemgr_lock();
+    int64_t now = scheduler_now_ms();
+    duration = devicemgr_frameDuration(pending->cells, pending->count, fullRotation);
+    int drop = !final && now + duration > next_due && pending->drops < SFANIM_MAX_DROPS;
+    int late = now + duration > due + SFANIM_TOLERANCE_MS;
+    if (!drop)
+    {
+        u_int32_t arrival = 0;
+        if (due > now + duration)
+        {
+            arrival = sfbus_ticks_now() + (u_int32_t)((due - now) * 1000 / SFBUS_TICK_US);
+        }
+        devicemgr_printFrame(pending->cells, pending->count, fullRotation, arrival);
+        pending->count = 0;
+    }
+    pending->drops = drop ? pending->drops + 1 : 0;
+    devicemgr_unlock();
+
+    pthread_mutex_lock(&animLock);
+    player.dropped += drop ? 1 : 0;
+    player.shown += drop ? 0 : 1;
+    player.late += !drop && late ? 1 : 0;
+    return playGeneration == generation;
+}
+
+static void *animation_loop(void *arg)
+{
+    struct SFANIM_PENDING pending = {0, 0, 0, NULL};
+    pthread_mutex_lock(&animLock);
+    while (1)
+    {
+        while (player.playing < 0)
+        {
+            pthread_cond_wait(&animCond, &animLock);
+        }
+        u_int32_t generation = playGeneration;
+        struct SFANIM *anim = &animations[player.playing];
+        int64_t due = playStart;
+        int running = 1;
+        pending.count = 0;
+        pending.drops = 0;
+        for (player.loop = 0; running && (anim->loops == 0 || player.loop < anim->loops); player.loop++)
+        {
+            for (player.frame = 0; running && player.frame < anim->frame_count; player.frame++)
+            {
+                // frames may be replaced while unlocked, which stops the player
+                struct SFANIM_FRAME *frame = &anim->frames[player.frame];
+                int64_t next_due = due + frame->duration_ms;
+                int final = anim->loops > 0 && player.loop == anim->loops - 1 && player.frame == anim->frame_count - 1;
+                running = animation_frame(frame, &pending, anim->full_rotation, due, next_due, final, generation);
+                due = next_due;
+            }
+        }
+        if (running)
+        {
+            printf("[INFO][animation] %s finished\n", anim->name);
+            player.playing = -1;
+            playGeneration++;
+        }
+    }
+    return NULL;
+}
+
+void animation_start()
+{
+    pthread_create(&animThread, NULL, animation_loop, NULL);
+}
+
+// parse frame object into frame. returns NULL or error detail
+static char *animation_parseFrame(json_object *jframe, struct SFANIM_FRAME *frame)
+{
+    json_object *jrows = json_object_object_get(jframe, "rows");
+    json_object *jdelays = json_object_object_get(jframe, "delays_ms");
+    json_object *jval;
+    int x = json_object_object_get_ex(jframe, "x", &jval) ? json_object_get_int(jval) : 0;
+    int y = json_object_object_get_ex(jframe, "y", &jval) ? json_object_get_int(jval) : 0;
+    frame->cell_count = 0;
+    frame->cells = NULL;
+    if (!json_object_object_get_ex(jframe, "duration_ms", &jval))
+    {
+        return "missing key: duration_ms";
+    }
+    frame->duration_ms = json_object_get_int(jval);
+    if (jrows == NULL || !json_object_is_type(jrows, json_type_array))
+    {
+        return "missing key: rows";
+    }
+    int rows = (int)json_object_array_length(jrows);
+    int length = 0;
+    for (int row = 0; row < rows; row++)
+    {
+        const char *text = json_object_get_string(json_object_array_get_idx(jrows, row));
+        length += text == NULL ? 0 : (int)strlen(text);
+    }
+    frame->cells = malloc(sizeof(struct SFDEVICE_CELL) * (length > 0 ? length : 1));
+    for (int row = 0; row < rows; row++)
+    {
+        const char *text = json_object_get_string(json_object_array_get_idx(jrows, row));
+        json_object *jrow_delays = jdelays == NULL ? NULL : json_object_array_get_idx(jdelays, row);
+        int cols = text == NULL ? 0 : (int)strlen(text);
+        int delays = jrow_delays == NULL ? 0 : (int)json_object_array_length(jrow_delays);
+        for (int col = 0; col < cols; col++)
+        {
+            if (x + col < 0 || x + col >= SFDEVICE_GRID_MAX || y + row < 0 || y + row >= SFDEVICE_GRID_MAX)
+            {
+                return "frame exceeds grid";
+            }
+            int ix = findFlap(text[col]); // characters without flap keep the cell
+            if (ix < 0)
+            {
+                continue;
+            }
+            struct SFDEVICE_CELL *cell = &frame->cells[frame->cell_count++];
+            cell->x = x + col;
+            cell->y = y + row;
+            cell->flap = ix;
+            cell->delay_ms = 0;
+            if (col < delays)
+            {
+                cell->delay_ms = json_object_get_int(json_object_array_get_idx(jrow_delays, col));
+            }
+        }
+    }
+    return NULL;
+}
+
+// store animation from request. An animation with the same name is replaced
+void animation_upload(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    json_object *jframes = json_object_object_get(req, "frames");
+    json_object *jval;
+    if (jname == NULL || jframes == NULL || !json_object_is_type(jframes, json_type_array))
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string(jname == NULL ? "missing key: name"
+                                                                                   : "missing key: frames"));
+        return;
+    }
+    int count = json_object_array_length(jframes);
+    if (count < 1 || count > SFANIM_MAXFRAMES)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("invalid amount of frames"));
+        return;
+    }
+    struct SFANIM anim;
+    strncpy(anim.name, json_object_get_string(jname), SFANIM_NAME_LEN - 1);
+    anim.name[SFANIM_NAME_LEN - 1] = 0;
+    anim.loops = json_object_object_get_ex(req, "loops", &jval) ? json_object_get_int(jval) : 1;
+    anim.full_rotation = devicemgr_parseMove(json_object_object_get(req, "full_rotation"), SFDEVICE_MOVE_DIRECT);
+    anim.frame_count = count;
+    anim.frames = calloc(count, sizeof(struct SFANIM_FRAME));
+    for (int i = 0; i < count; i++)
+    {
+        char *detail = animation_parseFrame(json_object_array_get_idx(jframes, i), &anim.frames[i]);
+        if (detail != NULL)
+        {
+            animation_free(&anim);
+            json_object_object_add(res, "error", json_object_new_string("format error"));
+            json_object_object_add(res, "detail", json_object_new_string(detail));
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&animLock);
+    int slot = animation_find(anim.name);
+    for (int i = 0; i < SFANIM_MAX && slot < 0; i++)
+    {
+        slot = animations[i].frames == NULL ? i : -1;
+    }
+    if (slot < 0)
+    {
+        pthread_mutex_unlock(&animLock);
+        animation_free(&anim);
+        json_object_object_add(res, "error", json_object_new_string("animation error"));
+        json_object_object_add(res, "detail", json_object_new_string("no free slot"));
+        return;
+    }
+    if (player.playing == slot)
+    {
+        player.playing = -1;
+        playGeneration++;
+        pthread_cond_broadcast(&animCond);
+    }
+    animation_free(&animations[slot]);
+    animations[slot] = anim;
+    pthread_mutex_unlock(&animLock);
+    json_object_object_add(res, "ack", json_object_new_boolean(true));
+    json_object_object_add(res, "frames", json_object_new_int(count));
+}
+
+// delete animation. returns -1 if not found
+int animation_remove(const char *name)
+{
+    pthread_mutex_lock(&animLock);
+    int slot = animation_find(name);
+    if (slot >= 0)
+    {
+        if (player.playing == slot)
+        {
+            player.playing = -1;
+            playGeneration++;
+            pthread_cond_broadcast(&animCond);
+        }
+        animation_free(&animations[slot]);
+        animations[slot].name[0] = 0;
+    }
+    pthread_mutex_unlock(&animLock);
+    return slot < 0 ? -1 : 0;
+}
+
+// play animation, first frame is in place at start_at (unix time in ms, 0 =
+// as soon as possible). A playing animation is stopped. Call with
+// devicemgr_lock held. returns -1 if not found
+int animation_play(const char *name, int64_t start_at)
+{
+    pthread_mutex_lock(&animLock);
+    int slot = animation_find(name);
+    if (slot >= 0)
+    {
+        struct SFANIM_FRAME *first = &animations[slot].frames[0];
+        int64_t earliest = scheduler_now_ms() + SFANIM_MARGIN_MS +
+                           devicemgr_frameDuration(first->cells, first->cell_count, animations[slot].full_rotation);
+        playStart = start_at > earliest ? start_at : earliest;
+        player.playing = slot;
+        player.loop = 0;
+        player.frame = 0;
+        player.shown = 0;
+        player.dropped = 0;
+        player.late = 0;
+        playGeneration++;
+        pthread_cond_broadcast(&animCond);
+    }
+    pthread_mutex_unlock(&animLock);
+    return slot < 0 ? -1 : 0;
+}
+
+void animation_stop()
+{
+    pthread_mutex_lock(&animLock);
+    player.playing = -1;
+    playGeneration++;
+    pthread_cond_broadcast(&animCond);
+    pthread_mutex_unlock(&animLock);
+}
+
+// add stored animations, player state and counters to res
+void animation_status(json_object *res)
+{
+    json_object *list = json_object_new_array();
+    pthread_mutex_lock(&animLock);
+    for (int i = 0; i < SFANIM_MAX; i++)
+    {
+        if (animations[i].frames == NULL)
+        {
+            continue;
+        }
+        int duration = 0;
+        for (int f = 0; f < animations[i].frame_count; f++)
+        {
+            duration += animations[i].frames[f].duration_ms;
+        }
+        json_object *entry = json_object_new_object();
+        json_object_object_add(entry, "name", json_object_new_string(animations[i].name));
+        json_object_object_add(entry, "frames", json_object_new_int(animations[i].frame_count));
+        json_object_object_add(entry, "loops", json_object_new_int(animations[i].loops));
+        json_object_object_add(entry, "duration_ms", json_object_new_int(duration));
+        json_object_array_add(list, entry);
+    }
+    json_object_object_add(res, "animations", list);
+    json_object_object_add(res, "playing", player.playing < 0 ? NULL
+                                                              : json_object_new_string(animations[player.playing].name));
+    json_object_object_add(res, "loop", json_object_new_int(player.loop));
+    json_object_object_add(res, "frame", json_object_new_int(player.frame));
+    json_object_object_add(res, "shown", json_object_new_int64(player.shown));
+    json_object_object_add(res, "dropped", json_object_new_int64(player.dropped));
+    json_object_object_add(res, "late", json_object_new_int64(player.late));
+    pthread_mutex_unlock(&animLock);
+}
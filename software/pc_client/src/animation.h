@@ -0,0 +1,62 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ */
+
+#pragma once
+#include "devicemgr.h"
+
+#define SFANIM_MAX 8                                  // stored animations
+#define SFANIM_MAXFRAMES 128                          // frames per animation
+#define SFANIM_NAME_LEN 32     // max. length of animation name
+#define SFANIM_MARGIN_MS 100   // sending starts this much before estimated time
+#define SFANIM_TOLERANCE_MS 20 // frame arriving later is counted as late
+#define SFANIM_MAX_DROPS 4     // frames dropped in a row, before pending is printed anyway
+
+// keyframe, cells that are not listed keep their flap
+struct SFANIM_FRAME
+{
+    int cell_count;
+    struct SFDEVICE_CELL *cells;
+    u_int16_t duration_ms; // time until next frame starts
+};
+
+// cells of frames not printed yet, see animation_merge
+struct SFANIM_PENDING
+{
+    int count;
+    int capacity;
+    int drops; // frames dropped since pending was printed
+    struct SFDEVICE_CELL *cells;
+};
+
+struct SFANIM
+{
+    char name[SFANIM_NAME_LEN]; // empty if slot is unused
+    int loops;                  // repetitions, 0 = endless
+    int full_rotation;
+    int frame_count;
+    struct SFANIM_FRAME *frames;
+};
+
+// state and counters of player, see animation_status
+struct SFANIM_PLAYER
+{
+    int playing;        // index of animation, -1 if stopped
+    int loop;           // current repetition
+    int frame;          // current frame
+    u_int32_t shown;    // printed frames
+    u_int32_t dropped;  // frames that could not be delivered in time, merged into next frame
+    u_int32_t late;     // printed frames that arrived after their start
+};
+
+void animation_start();
+void animation_upload(json_object *req, json_object *res);
+int animation_remove(const char *name);
+int animation_play(const char *name, int64_t start_at);
+void animation_stop();
+void animation_status(json_object *res);
@@ -23,10 +23,15 @@ void cmd_dm_dump(json_object *req, json_object *res)
 void cmd_dm_describe(json_object *req, json_object *res)
 {
     json_object *id;
+    json_object *jaddr;
     if (json_object_object_get_ex(req, "id", &id))
     {
         devicemgr_printDetails(json_object_get_int(id), res);
     }
+    else if (json_object_object_get_ex(req, "address", &jaddr))
+    {
+        devicemgr_printDetails(devicemgr_findAddress(json_object_get_int(jaddr)), res);
+    }
     else
     {
         json_object_object_add(res, "error", json_object_new_string("format error"));
@@ -63,6 +68,15 @@ void cmd_dm_register(json_object *req, json_object *res)
         printf("[INFO][console] register new device wit addr %i at (%i,%i)", address, x, y);
 
         int newId = devicemgr_register(fd, address, x, y, -1);
+        if (newId < 0)
+        {
+            json_object_object_add(res, "error", json_object_new_string("register error"));
+            json_object_object_add(res, "detail",
+                                   json_object_new_string(newId == -1   ? "position out of range"
+                                                          : newId == -2 ? "address invalid or in use"
+                                                                        : "no free device id"));
+            return;
+        }
         json_object_object_add(res, "id", json_object_new_int(newId));
     }
 }
@@ -70,8 +84,16 @@ void cmd_dm_register(json_object *req, json_object *res)
 // refresh all devices
 void cmd_dm_refresh(json_object *req, json_object *res)
 {
-    int devices_online = devicemgr_refresh();
+    int skipped = 0;
+    int devices_online = devicemgr_refresh(&skipped);
+    if (devices_online == 0 && skipped > 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("bus error"));
+        json_object_object_add(res, "detail", json_object_new_string("airtime budget of status polling used up"));
+        return;
+    }
     json_object_object_add(res, "devices_online", json_object_new_int(devices_online));
+    json_object_object_add(res, "skipped", json_object_new_int(skipped));
 }
 
 
@@ -88,7 +110,12 @@ void cmd_dm_remove(json_object *req, json_object *res)
     else
     {
         id = json_object_get_int(jid);
-        devicemgr_remove(id);
+        if (devicemgr_remove(id) < 0)
+        {
+            json_object_object_add(res, "error", json_object_new_string("remove error"));
+            json_object_object_add(res, "detail", json_object_new_string("invalid id"));
+            return;
+        }
         json_object_object_add(res, "ack", json_object_new_boolean(true));
     }
 }
@@ -108,6 +135,22 @@ void cmd_dm_load(json_object *req, json_object *res)
 }
 
 
+// calibrate all devices
+void cmd_dm_calibrate(json_object *req, json_object *res)
+{
+    json_object *jrounds = json_object_object_get(req, "rounds");
+    json_object *joverwrite = json_object_object_get(req, "overwrite");
+    int rounds = jrounds == NULL ? 3 : json_object_get_int(jrounds);
+    int overwrite = joverwrite == NULL ? 0 : json_object_get_boolean(joverwrite);
+    devicemgr_calibrate(rounds, overwrite, res);
+}
+
+// read or change power budget for motor starts
+void cmd_dm_power(json_object *req, json_object *res)
+{
+    devicemgr_power(req, res);
+}
+
 // print string on display
 void cmd_dm_print(json_object *req, json_object *res)
 {
@@ -134,11 +177,289 @@ void cmd_dm_print(json_object *req, json_object *res)
         int x = json_object_get_int(jx);
         int y = json_object_get_int(jy);
         char *str = json_object_get_string(jstr);
-        devicemgr_printText(str, x, y);
+        int fullRotation = devicemgr_parseMove(json_object_object_get(req, "full_rotation"), SFDEVICE_MOVE_AUTO);
+        json_object *japply = json_object_object_get(req, "apply_at");
+        if (japply == NULL)
+        {
+            int eta = devicemgr_printText(str, x, y, fullRotation, 0);
+            json_object_object_add(res, "ack", json_object_new_boolean(true));
+            json_object_object_add(res, "eta_ms", json_object_new_int(eta));
+            return;
+        }
+        // text is in place at apply_at (unix time in ms)
+        int64_t apply_at = json_object_get_int64(japply);
+        int job = scheduler_add(str, x, y, fullRotation, apply_at);
+        if (job < 0)
+        {
+            json_object_object_add(res, "error", json_object_new_string("scheduler error"));
+            json_object_object_add(res, "detail", json_object_new_string("job queue full"));
+            return;
+        }
+        json_object_object_add(res, "ack", json_object_new_boolean(true));
+        json_object_object_add(res, "job", json_object_new_int(job));
+        json_object_object_add(res, "eta_ms", json_object_new_int64(apply_at - scheduler_now_ms()));
+    }
+}
+
+// deadline scheduler counters
+void cmd_dm_metrics(json_object *req, json_object *res)
+{
+    scheduler_metrics(res);
+    devicemgr_verifyMetrics(res);
+}
+
+// read or change airtime limits
+void cmd_dm_airtime(json_object *req, json_object *res)
+{
+    devicemgr_airtime(req, res);
+}
+
+// telemetry history of single device
+void cmd_dm_history(json_object *req, json_object *res)
+{
+    json_object *jid;
+    json_object *jaddr;
+    json_object *jres = json_object_object_get(req, "resolution");
+    json_object *jfrom = json_object_object_get(req, "from");
+    json_object *jto = json_object_object_get(req, "to");
+    int id = -1;
+    if (json_object_object_get_ex(req, "id", &jid))
+    {
+        id = json_object_get_int(jid);
+    }
+    else if (json_object_object_get_ex(req, "address", &jaddr))
+    {
+        id = devicemgr_findAddress(json_object_get_int(jaddr));
+    }
+    else
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: id"));
+        return;
+    }
+    int resolution = jres == NULL ? 60 : json_object_get_int(jres);
+    int64_t from = jfrom == NULL ? 0 : json_object_get_int64(jfrom);
+    int64_t to = jto == NULL ? 0 : json_object_get_int64(jto);
+    if (id < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("device error"));
+        json_object_object_add(res, "detail", json_object_new_string("device not found"));
+        return;
+    }
+    json_object_object_add(res, "id", json_object_new_int(id));
+    if (telemetry_query(id, resolution, from, to, res) < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("resolution must be 1, 60 or 3600"));
+    }
+}
+
+// set status poll interval for telemetry
+void cmd_dm_telemetry(json_object *req, json_object *res)
+{
+    json_object *jinterval = json_object_object_get(req, "interval");
+    if (jinterval != NULL)
+    {
+        telemetry_interval(json_object_get_int(jinterval));
+    }
+    json_object_object_add(res, "interval", json_object_new_int(telemetry_getInterval()));
+}
+
+// define zone of devices, see devicemgr_zoneDefine
+void cmd_dm_zone_define(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    if (jname == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: name"));
+        return;
+    }
+    const char *name = json_object_get_string(jname);
+    if (strlen(name) == 0 || strlen(name) >= SFDEVICE_ZONE_NAME)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("name must have 1 to 31 characters"));
+        return;
+    }
+    int group = devicemgr_zoneDefine(name, req, res);
+    if (group < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("zone error"));
+        json_object_object_add(res, "detail",
+                               json_object_new_string(group == -1   ? "no devices selected by ids, row or rect"
+                                                      : group == -2 ? "no free group address"
+                                                                    : "device is member of too many zones"));
+        return;
+    }
+    json_object_object_add(res, "group", json_object_new_int(group));
+    json_object_object_add(res, "ack", json_object_new_boolean(true));
+}
+
+// remove zone
+void cmd_dm_zone_remove(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    if (jname == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: name"));
+    }
+    else if (devicemgr_zoneRemove(json_object_get_string(jname), res) < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("zone error"));
+        json_object_object_add(res, "detail", json_object_new_string("zone not found"));
+    }
+    else
+    {
         json_object_object_add(res, "ack", json_object_new_boolean(true));
     }
 }
 
+// list zones
+void cmd_dm_zones(json_object *req, json_object *res)
+{
+    devicemgr_zones(res);
+}
+
+// send one frame to all devices of zone: display, power, reset or sync
+void cmd_dm_zone(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    json_object *jaction = json_object_object_get(req, "action");
+    json_object *jflap = json_object_object_get(req, "flap");
+    json_object *jpower = json_object_object_get(req, "power");
+    if (jname == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: name"));
+        return;
+    }
+    if (jaction == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: action"));
+        return;
+    }
+    const char *name = json_object_get_string(jname);
+    const char *action = json_object_get_string(jaction);
+    int result;
+    if (strcmp(action, "display") == 0)
+    {
+        if (jflap == NULL)
+        {
+            json_object_object_add(res, "error", json_object_new_string("format error"));
+            json_object_object_add(res, "detail", json_object_new_string("missing key: flap"));
+            return;
+        }
+        int fullRotation = devicemgr_parseMove(json_object_object_get(req, "full_rotation"), SFDEVICE_MOVE_AUTO);
+        int grouped = 1;
+        result = devicemgr_zoneDisplay(name, json_object_get_int(jflap), fullRotation, &grouped);
+        if (result == -2)
+        {
+            json_object_object_add(res, "error", json_object_new_string("format error"));
+            json_object_object_add(res, "detail", json_object_new_string("invalid flap"));
+            return;
+        }
+        if (result >= 0)
+        {
+            json_object_object_add(res, "eta_ms", json_object_new_int(result));
+            json_object_object_add(res, "grouped", json_object_new_boolean(grouped));
+        }
+    }
+    else if (strcmp(action, "power") == 0)
+    {
+        if (jpower == NULL)
+        {
+            json_object_object_add(res, "error", json_object_new_string("format error"));
+            json_object_object_add(res, "detail", json_object_new_string("missing key: power"));
+            return;
+        }
+        result = devicemgr_zonePower(name, json_object_get_boolean(jpower));
+    }
+    else if (strcmp(action, "reset") == 0)
+    {
+        result = devicemgr_zoneReset(name);
+    }
+    else if (strcmp(action, "sync") == 0)
+    {
+        result = devicemgr_zoneSync(name, res);
+    }
+    else
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("action must be display, power, reset or sync"));
+        return;
+    }
+    if (result == -1)
+    {
+        json_object_object_add(res, "error", json_object_new_string("zone error"));
+        json_object_object_add(res, "detail", json_object_new_string("zone not found"));
+        return;
+    }
+    json_object_object_add(res, "ack", json_object_new_boolean(true));
+}
+
+// store keyframe animation
+void cmd_an_upload(json_object *req, json_object *res)
+{
+    animation_upload(req, res);
+}
+
+// play stored animation
+void cmd_an_play(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    json_object *jstart = json_object_object_get(req, "start_at");
+    if (jname == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: name"));
+    }
+    else if (animation_play(json_object_get_string(jname), jstart == NULL ? 0 : json_object_get_int64(jstart)) < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("animation error"));
+        json_object_object_add(res, "detail", json_object_new_string("animation not found"));
+    }
+    else
+    {
+        json_object_object_add(res, "ack", json_object_new_boolean(true));
+    }
+}
+
+// stop playing animation
+void cmd_an_stop(json_object *req, json_object *res)
+{
+    animation_stop();
+    json_object_object_add(res, "ack", json_object_new_boolean(true));
+}
+
+// delete stored animation
+void cmd_an_remove(json_object *req, json_object *res)
+{
+    json_object *jname = json_object_object_get(req, "name");
+    if (jname == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: name"));
+    }
+    else if (animation_remove(json_object_get_string(jname)) < 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("animation error"));
+        json_object_object_add(res, "detail", json_object_new_string("animation not found"));
+    }
+    else
+    {
+        json_object_object_add(res, "ack", json_object_new_boolean(true));
+    }
+}
+
+// stored animations and player counters
+void cmd_an_status(json_object *req, json_object *res)
+{
+    animation_status(res);
+}
+
 // set flap on display
 void cmd_dm_print_single(json_object *req, json_object *res)
 {
@@ -209,10 +530,22 @@ void cmd_dr_setaddress(json_object *req, json_object *res)
         json_object_object_add(res, "error", json_object_new_string("format error"));
         json_object_object_add(res, "detail", json_object_new_string("missing key: newaddress"));
     }
+    else if (json_object_get_int(jaddrn) >= SFBUS_ADDR_GROUP_MIN)
+    {
+        json_object_object_add(res, "error", json_object_new_string("address error"));
+        json_object_object_add(res, "detail", json_object_new_string("newaddress is reserved for groups"));
+    }
+    else if (json_object_get_int(jaddr) != json_object_get_int(jaddrn) &&
+             devicemgr_findAddress(json_object_get_int(jaddrn)) >= 0)
+    {
+        json_object_object_add(res, "error", json_object_new_string("address error"));
+        json_object_object_add(res, "detail", json_object_new_string("newaddress is used by another device"));
+    }
     else
     {
         if (sfbusu_write_address(fd, json_object_get_int(jaddr), json_object_get_int(jaddrn)) == 0)
         {
+            devicemgr_changeAddress(json_object_get_int(jaddr), json_object_get_int(jaddrn));
             json_object_object_add(res, "success", json_object_new_boolean(true));
         }
         else
@@ -240,6 +573,86 @@ void cmd_dr_setcalibration(json_object *req, json_object *res)
     {
         if (sfbusu_write_calibration(fd, json_object_get_int(jaddr), json_object_get_int(jcal)) == 0)
         {
+            int id = devicemgr_findAddress(json_object_get_int(jaddr));
+            if (id >= 0)
+            {
+                devicemgr_readCalib(id);
+            }
+            json_object_object_add(res, "success", json_object_new_boolean(true));
+        }
+        else
+        {
+            json_object_object_add(res, "success", json_object_new_boolean(false));
+        }
+    }
+}
+
+// read per-flap calibration table
+void cmd_dr_getflapcal(json_object *req, json_object *res)
+{
+    json_object *jaddr = json_object_object_get(req, "address");
+    if (jaddr == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: address"));
+    }
+    else
+    {
+        int8_t table[SFBUS_FLAPS];
+        if (sfbus_read_flapcal(fd, json_object_get_int(jaddr), table) == 0)
+        {
+            json_object *jtable = json_object_new_array();
+            for (int i = 0; i < SFBUS_FLAPS; i++)
+            {
+                json_object_array_add(jtable, json_object_new_int(table[i]));
+            }
+            json_object_object_add(res, "table", jtable);
+            json_object_object_add(res, "success", json_object_new_boolean(true));
+        }
+        else
+        {
+            json_object_object_add(res, "success", json_object_new_boolean(false));
+        }
+    }
+}
+
+// write per-flap calibration table
+void cmd_dr_setflapcal(json_object *req, json_object *res)
+{
+    json_object *jaddr = json_object_object_get(req, "address");
+    json_object *jtable = json_object_object_get(req, "table");
+    json_object *jstart = json_object_object_get(req, "start");
+    int start = jstart == NULL ? 0 : json_object_get_int(jstart);
+    if (jaddr == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: address"));
+    }
+    else if (jtable == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: table"));
+    }
+    else if (start < 0 || start + json_object_array_length(jtable) > SFBUS_FLAPS)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("table exceeds flap count"));
+    }
+    else
+    {
+        int count = json_object_array_length(jtable);
+        int8_t values[SFBUS_FLAPS];
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = json_object_get_int(json_object_array_get_idx(jtable, i));
+        }
+        if (sfbus_write_flapcal(fd, json_object_get_int(jaddr), start, count, values) == 0)
+        {
+            int id = devicemgr_findAddress(json_object_get_int(jaddr));
+            if (id >= 0)
+            {
+                devicemgr_readCalib(id);
+            }
             json_object_object_add(res, "success", json_object_new_boolean(true));
         }
         else
@@ -260,6 +673,7 @@ void cmd_dr_reset(json_object *req, json_object *res)
     else
     {
         sfbus_reset_device(fd, json_object_get_int(jaddr));
+        devicemgr_rawReset(json_object_get_int(jaddr));
         json_object_object_add(res, "ack", json_object_new_boolean(true));
     }
 }
@@ -269,6 +683,7 @@ void cmd_dr_display(json_object *req, json_object *res)
     json_object *jaddr = json_object_object_get(req, "address");
     json_object *jflap = json_object_object_get(req, "flap");
     json_object *jfullrot = json_object_object_get(req, "full");
+    json_object *jdelay = json_object_object_get(req, "delay");
     if (jaddr == NULL)
     {
         json_object_object_add(res, "error", json_object_new_string("format error"));
@@ -279,6 +694,17 @@ void cmd_dr_display(json_object *req, json_object *res)
         json_object_object_add(res, "error", json_object_new_string("format error"));
         json_object_object_add(res, "detail", json_object_new_string("missing key: flap"));
     }
+    else if (jdelay != NULL)
+    {
+        // scheduled display: start moving after delay (ms) on bus time
+        devicemgr_timeSync(0);
+        int fullrot = jfullrot != NULL && json_object_get_boolean(jfullrot);
+        u_int32_t tick = sfbus_ticks_now() + (json_object_get_int(jdelay) * 1000) / SFBUS_TICK_US;
+        sfbus_display_at(fd, json_object_get_int(jaddr), json_object_get_int(jflap), fullrot, tick);
+        devicemgr_rawState(json_object_get_int(jaddr), json_object_get_int(jflap), fullrot, tick, -1);
+        json_object_object_add(res, "ack", json_object_new_boolean(true));
+        json_object_object_add(res, "tick", json_object_new_int64(tick));
+    }
     else
     {
         if (jfullrot == NULL)
@@ -293,6 +719,8 @@ void cmd_dr_display(json_object *req, json_object *res)
         {
             sfbus_display_full(fd, json_object_get_int(jaddr), json_object_get_int(jflap));
         }
+        devicemgr_rawState(json_object_get_int(jaddr), json_object_get_int(jflap),
+                           jfullrot != NULL && json_object_get_boolean(jfullrot), 0, -1);
         json_object_object_add(res, "ack", json_object_new_boolean(true));
     }
 }
@@ -321,10 +749,79 @@ void cmd_dr_power(json_object *req, json_object *res)
         {
             sfbus_motor_power(fd, json_object_get_int(jaddr), 1);
         }
+        devicemgr_rawState(json_object_get_int(jaddr), -1, 0, 0, json_object_get_boolean(jpower));
         json_object_object_add(res, "ack", json_object_new_boolean(true));
     }
 }
 
+// display sequence of flaps on single device
+void cmd_dr_sequence(json_object *req, json_object *res)
+{
+    json_object *jaddr = json_object_object_get(req, "address");
+    json_object *jflaps = json_object_object_get(req, "flaps");
+    json_object *jdwell = json_object_object_get(req, "dwell");
+    if (jaddr == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: address"));
+    }
+    else if (jflaps == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: flaps"));
+    }
+    else if (jdwell == NULL)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("missing key: dwell"));
+    }
+    else if (json_object_array_length(jflaps) > SFBUS_QUEUE_LEN)
+    {
+        json_object_object_add(res, "error", json_object_new_string("format error"));
+        json_object_object_add(res, "detail", json_object_new_string("too many flaps"));
+    }
+    else
+    {
+        u_int8_t count = json_object_array_length(jflaps);
+        u_int8_t flaps[SFBUS_QUEUE_LEN];
+        u_int16_t dwell[SFBUS_QUEUE_LEN];
+        for (int i = 0; i < count; i++)
+        {
+            int flap = json_object_get_int(json_object_array_get_idx(jflaps, i));
+            flaps[i] = flap < 0 || flap >= SFBUS_FLAPS ? SFBUS_FLAPS : flap; // rejected by sfbus_enqueue
+            // dwell is either one value for all flaps or an array
+            if (json_object_get_type(jdwell) == json_type_array)
+            {
+                dwell[i] = json_object_get_int(json_object_array_get_idx(jdwell, i));
+            }
+            else
+            {
+                dwell[i] = json_object_get_int(jdwell);
+            }
+        }
+        if (sfbus_enqueue(fd, json_object_get_int(jaddr), flaps, dwell, count) < 0)
+        {
+            json_object_object_add(res, "error", json_object_new_string("format error"));
+            json_object_object_add(res, "detail", json_object_new_string("invalid flap"));
+            return;
+        }
+        // entries start after the current move and the dwell time of the previous entry
+        u_int32_t tick = devicemgr_rawState(json_object_get_int(jaddr), -1, 0, 0, -1);
+        for (int i = 0; i < count; i++)
+        {
+            tick = devicemgr_rawState(json_object_get_int(jaddr), flaps[i], 0, tick, -1);
+            tick += ((u_int32_t)dwell[i] * 1000) / SFBUS_TICK_US;
+        }
+        json_object_object_add(res, "ack", json_object_new_boolean(true));
+    }
+}
+
+// broadcast bus time to all devices
+void cmd_dr_sync(json_object *req, json_object *res)
+{
+    devicemgr_timeSync(1);
+    json_object_object_add(res, "ack", json_object_new_boolean(true));
+}
 
 // command parser
 json_object *parse_command(json_object *req)
@@ -370,11 +867,86 @@ json_object *parse_command(json_object *req)
         cmd_dm_load(req, res);
         return res;
     }
+    else if (strcmp(command, "dm_calibrate") == 0)
+    {
+        cmd_dm_calibrate(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_power") == 0)
+    {
+        cmd_dm_power(req, res);
+        return res;
+    }
     else if (strcmp(command, "dm_print") == 0)
     {
         cmd_dm_print(req, res);
         return res;
     }
+    else if (strcmp(command, "dm_metrics") == 0)
+    {
+        cmd_dm_metrics(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_airtime") == 0)
+    {
+        cmd_dm_airtime(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_history") == 0)
+    {
+        cmd_dm_history(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_telemetry") == 0)
+    {
+        cmd_dm_telemetry(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_zone_define") == 0)
+    {
+        cmd_dm_zone_define(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_zone_remove") == 0)
+    {
+        cmd_dm_zone_remove(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_zones") == 0)
+    {
+        cmd_dm_zones(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dm_zone") == 0)
+    {
+        cmd_dm_zone(req, res);
+        return res;
+    }
+    else if (strcmp(command, "an_upload") == 0)
+    {
+        cmd_an_upload(req, res);
+        return res;
+    }
+    else if (strcmp(command, "an_play") == 0)
+    {
+        cmd_an_play(req, res);
+        return res;
+    }
+    else if (strcmp(command, "an_stop") == 0)
+    {
+        cmd_an_stop(req, res);
+        return res;
+    }
+    else if (strcmp(command, "an_remove") == 0)
+    {
+        cmd_an_remove(req, res);
+        return res;
+    }
+    else if (strcmp(command, "an_status") == 0)
+    {
+        cmd_an_status(req, res);
+        return res;
+    }
     else if (strcmp(command, "dr_ping") == 0)
     {
         cmd_dr_ping(req, res);
@@ -390,6 +962,16 @@ json_object *parse_command(json_object *req)
         cmd_dr_setcalibration(req, res);
         return res;
     }
+    else if (strcmp(command, "dr_getflapcal") == 0)
+    {
+        cmd_dr_getflapcal(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dr_setflapcal") == 0)
+    {
+        cmd_dr_setflapcal(req, res);
+        return res;
+    }
     else if (strcmp(command, "dr_reset") == 0)
     {
         cmd_dr_reset(req, res);
@@ -405,6 +987,16 @@ json_object *parse_command(json_object *req)
         cmd_dr_power(req, res);
         return res;
     }
+    else if (strcmp(command, "dr_sequence") == 0)
+    {
+        cmd_dr_sequence(req, res);
+        return res;
+    }
+    else if (strcmp(command, "dr_sync") == 0)
+    {
+        cmd_dr_sync(req, res);
+        return res;
+    }
     else
     {
         json_object_object_add(res, "error", json_object_new_string("invalid command"));
@@ -414,12 +1006,31 @@ json_object *parse_command(json_object *req)
     return NULL;
 }
 
+// websocket clients are handled in parallel, process one command at a time
+json_object *parse_command_locked(json_object *req)
+{
+    devicemgr_lock();
+    json_object *res = parse_command(req);
+    devicemgr_unlock();
+    return res;
+}
+
 
 void start_console(int _fd)
 {
     fd = _fd;
     // init device manager
     devicemgr_init(fd);
+    // align tick counter of all devices
+    devicemgr_timeSync(1);
+    // execute print jobs with deadline
+    scheduler_start();
+    // play uploaded animations
+    animation_start();
+    // poll device status for telemetry
+    telemetry_start();
+    // check moves and resend lost ones
+    verifier_start();
     // start server
-    start_webserver(&parse_command);
+    start_webserver(&parse_command_locked);
 }
\ No newline at end of file
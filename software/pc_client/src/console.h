@@ -7,8 +7,12 @@
  *
  */
 
+#include "animation.h"
 #include "devicemgr.h"
+#include "scheduler.h"
 #include "sfbus-util.h"
+#include "telemetry.h"
+#include "verifier.h"
 #include "wsserver.h"
 #include <string.h>
 
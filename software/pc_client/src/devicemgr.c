@@ -10,7 +10,10 @@
  */
 
 #include "devicemgr.h"
+#include "telemetry.h"
+#include "verifier.h"
 #include <json-c/json_object.h>
+#include <pthread.h>
 #include <string.h>
 
 enum SFDEVICE_STATE
@@ -37,63 +40,451 @@ struct SFDEVICE
     u_int16_t calibration;
     int rs485_descriptor;
     double reg_voltage;
+    double reg_voltage_min; // voltage statistics since last status read
+    double reg_voltage_max;
+    double reg_voltage_avg;
+    u_int32_t reg_sags;     // total voltage sag events
+    u_int8_t status_ext;    // device supports extended status
+    u_int8_t ext_fails;     // invalid extended status replies in a row
+    u_int32_t ext_retry;    // extended status is tried again at this bus time, if not supported
+    u_int8_t poll_backoff;  // polls skipped after the last missing response, see devicemgr_poll
+    u_int8_t poll_skip;     // polls left to skip
     u_int32_t reg_counter;
     u_int8_t reg_status;
     u_int8_t current_flap;
+    int8_t flapcal[SFBUS_FLAPS]; // per-flap step correction, see moveTicks
+    u_int8_t seq_last;      // sequence number of last staged flap
+    u_int8_t full_rotation; // staged flap is shown after a full rotation
+    u_int8_t start_timed;   // staged flap starts at start_tick instead of commit
+    u_int32_t start_tick;   // scheduled start (bus time)
+    u_int32_t busy_until;   // expected end of last move (bus time)
+    u_int16_t moves_since_home; // direct moves since last predicted home pass
+    u_int16_t home_expected;    // home passes predicted since last status read
+    u_int8_t drift;             // drift suspected, next auto move is a full rotation
+    u_int8_t drift_events;      // home errors seen, shortens the direct move budget
+    int reg_flap;               // flap reported by device, -1 if not supported by firmware
+    u_int8_t verify_pending;    // last move is checked at verify_at, device is in verifyQueue
+    u_int8_t verify_resend;     // move is sent again at verify_at
+    u_int8_t verify_retries;    // resends of last move
+    u_int8_t verify_flap;       // target of last move
+    u_int8_t verify_full;       // last move is a full rotation
+    u_int32_t verify_at;        // next check or resend (bus time)
+    u_int32_t verify_deadline;  // device still busy at deadline is a failed move (bus time)
+    u_int32_t verify_counter;   // rotation counter expected after full rotation
     enum SFDEVICE_STATE deviceState;
     enum SFDEVICE_POWER powerState;
 };
 
 enum
 {
-    SFDEVICE_MAXDEV = 128,
-    SFDEVICE_MAX_X = 20,
-    SFDEVICE_MAX_Y = 4,
-    JSON_MAX_LINE_LEN = 256
+    SFDEVICE_STORE_MIN = 64,  // initial capacity of device store
+    SFDEVICE_POLL_BACKOFF_MAX = 32, // max. polls skipped for an offline device
+    SFDEVICE_CHUNK_BITS = 4,  // grid chunks of 16 x 16 cells
+    SFDEVICE_CHUNK = 1 << SFDEVICE_CHUNK_BITS,
+    SFDEVICE_GRID_MIN = 16,   // initial size of chunk table
+    SFDEVICE_ADDR_MIN = 64    // initial size of address table
+};
+
+// chunk of the sparse grid, see devicemgr_lookup
+struct SFGRID_CHUNK
+{
+    u_int32_t key; // chunk position (cy << 16) | cx
+    int ids[SFDEVICE_CHUNK * SFDEVICE_CHUNK]; // device ids, -1 if empty
+};
+
+enum
+{
+    SFDEVICE_STEPS_PER_REV = 2025,  // steps per revolution assumed by firmware
+    SFDEVICE_STEPS_PER_FLAP = 45,   // steps per flap
+    SFDEVICE_OFFSET_DEF = 1400,     // firmware default offset
+    SFDEVICE_OFFSET_MIN = 800,      // smaller offsets are replaced by default
+    SFDEVICE_IDLE_POLL_MS = 250,    // poll interval while waiting for devices
+    SFDEVICE_ROTATION_TIMEOUT = 10000, // max time for a full rotation in ms
+    SFDEVICE_SEQ_RETRIES = 2,          // resends of lost stage commands
+    SFDEVICE_SCHED_SLOT_TICKS = 4,     // time resolution of motor start scheduler
+    SFDEVICE_SCHED_LEAD_MS = 100,      // additional time before first scheduled start
+    SFDEVICE_DRIFT_MOVES = 32,         // direct moves without home pass before a full rotation
+    SFDEVICE_DRIFT_SHIFT_MAX = 3,      // budget is halved per home error, down to 1/8
+    SFDEVICE_VERIFY_MARGIN_MS = 100,   // moves are checked this long after their expected end
+    SFDEVICE_VERIFY_BUSY_MS = 250,     // recheck interval of devices still moving
+    SFDEVICE_VERIFY_BACKOFF_MS = 200,  // wait before first resend, doubled with every resend
+    SFDEVICE_VERIFY_RETRIES = 3,       // resends of failed moves
+    SFDEVICE_VERIFY_BATCH = 16,        // checks per call of devicemgr_verify
+    SFDEVICE_SYNC_PERIOD_MS = 30000,   // bus time is sent again after this time, see devicemgr_timeSync
+    SFDEVICE_EXT_FAILS = 3,            // invalid extended status replies before the basic status is used
+    SFDEVICE_EXT_RETRY_MS = 60000      // extended status is tried again after this time
+};
+
+// named set of devices sharing a group address
+struct SFZONE
+{
+    char name[SFDEVICE_ZONE_NAME];
+    u_int16_t group; // group address, SFBUS_ADDR_GROUP_MIN to SFBUS_ADDR_GROUP_MAX
+    int *ids;        // member device ids
+    int count;
+};
+
+// supply model of one bus, used to spread motor starts (see scheduleStarts)
+struct SFPOWER
+{
+    int budget_ma;      // max. current of all modules on one bus. 0 = no limit, start all at once
+    int inrush_ma;      // additional current while a motor starts or is powered on
+    int inrush_ms;      // duration of start current
+    int run_ma;         // current of a moving motor
+    int hold_ma;        // current of a powered, idle motor
+    int power_off_idle; // power off idle motors before an update to free budget
 };
 
 // next free slot to register device
 int nextFreeSlot = -1;
-int deviceMap[SFDEVICE_MAX_X][SFDEVICE_MAX_Y];
 int deviceFd;
-struct SFDEVICE devices[SFDEVICE_MAXDEV];
+// device store, grows with registered ids
+struct SFDEVICE *devices = NULL;
+int deviceCapacity = 0;
+// grid positions: open addressing table of chunks, only occupied chunks are allocated
+struct SFGRID_CHUNK **gridTable = NULL;
+int gridSize = 0;   // table size, power of 2
+int gridChunks = 0; // allocated chunks
+int gridWidth = 0;  // bounding box of registered positions
+int gridHeight = 0;
+// bus address to device id: open addressing table, address 0 marks empty slots
+u_int16_t *addrKeys = NULL;
+int *addrIds = NULL;
+int addrSize = 0; // table size, power of 2
+int addrCount = 0;
+struct SFPOWER power = {0, 600, 60, 250, 250, 0};
+// ids of devices with pending move check, see devicemgr_verify
+int *verifyQueue = NULL;
+int verifyCount = 0;
+int verifyCapacity = 0;
+struct SFVERIFY_METRICS verifyMetrics;
+// next device polled by devicemgr_poll
+int pollCursor = 0;
+// bus time must be sent before the next timed start, see devicemgr_timeSync
+u_int8_t timeSyncDue = 1;
+u_int32_t timeSyncTick = 0;
+// zones, each addressed with one group frame, see devicemgr_zoneDefine
+struct SFZONE *zones = NULL;
+int zoneCount = 0;
+// serializes bus access of websocket handlers and scheduler
+pthread_mutex_t busLock = PTHREAD_MUTEX_INITIALIZER;
 
 const char *symbols[45] = {" ", "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M", "N",
                            "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "Ä", "Ö", "Ü",
                            "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", ":", ".", "-", "?", "!"};
 
-void devicemgr_init(int fd)
+// grow device store, so id is a valid index. returns -1 if id is above
+// SFDEVICE_ID_MAX or out of memory
+static int storeReserve(int id)
 {
-    deviceFd = fd;
-    // reserve memory buffer
-    for (int y = 0; y < SFDEVICE_MAX_Y; y++)
+    if (id < deviceCapacity)
+    {
+        return 0;
+    }
+    if (id > SFDEVICE_ID_MAX)
+    {
+        return -1;
+    }
+    int capacity = deviceCapacity < SFDEVICE_STORE_MIN ? SFDEVICE_STORE_MIN : deviceCapacity;
+    while (capacity <= id)
+    {
+        capacity *= 2;
+    }
+    capacity = capacity > SFDEVICE_ID_MAX + 1 ? SFDEVICE_ID_MAX + 1 : capacity;
+    struct SFDEVICE *store = realloc(devices, sizeof(struct SFDEVICE) * capacity);
+    if (store == NULL)
+    {
+        return -1;
+    }
+    for (int ix = deviceCapacity; ix < capacity; ix++)
+    {
+        store[ix].address = 0; // Adress 0 is only used for new units. should never be used for active unit
+        store[ix].deviceState = UNALLOCATED;
+        store[ix].pos_x = -1;
+        store[ix].pos_y = -1;
+        store[ix].verify_pending = 0;
+    }
+    devices = store;
+    deviceCapacity = capacity;
+    return 0;
+}
+
+static u_int32_t gridKey(int x, int y)
+{
+    return ((u_int32_t)(y >> SFDEVICE_CHUNK_BITS) << 16) | (u_int32_t)(x >> SFDEVICE_CHUNK_BITS);
+}
+
+// slot of chunk in table, or of the empty slot where it belongs
+static int gridSlot(u_int32_t key)
+{
+    int slot = (key * 2654435761u) & (gridSize - 1);
+    while (gridTable[slot] != NULL && gridTable[slot]->key != key)
+    {
+        slot = (slot + 1) & (gridSize - 1);
+    }
+    return slot;
+}
+
+// chunk containing position, allocated if create is set. returns NULL if missing
+static struct SFGRID_CHUNK *gridChunk(int x, int y, int create)
+{
+    if (gridSize == 0)
+    {
+        if (!create)
+        {
+            return NULL;
+        }
+        gridSize = SFDEVICE_GRID_MIN;
+        gridTable = calloc(gridSize, sizeof(struct SFGRID_CHUNK *));
+    }
+    u_int32_t key = gridKey(x, y);
+    int slot = gridSlot(key);
+    if (gridTable[slot] != NULL || !create)
+    {
+        return gridTable[slot];
+    }
+    if ((gridChunks + 1) * 2 > gridSize)
+    { // keep load factor below 1/2
+        struct SFGRID_CHUNK **old = gridTable;
+        int old_size = gridSize;
+        gridSize *= 2;
+        gridTable = calloc(gridSize, sizeof(struct SFGRID_CHUNK *));
+        for (int i = 0; i < old_size; i++)
+        {
+            if (old[i] != NULL)
+            {
+                gridTable[gridSlot(old[i]->key)] = old[i];
+            }
+        }
+        free(old);
+        slot = gridSlot(key);
+    }
+    struct SFGRID_CHUNK *chunk = malloc(sizeof(struct SFGRID_CHUNK));
+    chunk->key = key;
+    for (int i = 0; i < SFDEVICE_CHUNK * SFDEVICE_CHUNK; i++)
+    {
+        chunk->ids[i] = -1;
+    }
+    gridTable[slot] = chunk;
+    gridChunks++;
+    return chunk;
+}
+
+static int gridIndex(int x, int y)
+{
+    return (y & (SFDEVICE_CHUNK - 1)) * SFDEVICE_CHUNK + (x & (SFDEVICE_CHUNK - 1));
+}
+
+// device id at position, -1 if position is empty or out of range
+int devicemgr_lookup(int x, int y)
+{
+    if (x < 0 || y < 0 || x >= SFDEVICE_GRID_MAX || y >= SFDEVICE_GRID_MAX)
+    {
+        return -1;
+    }
+    struct SFGRID_CHUNK *chunk = gridChunk(x, y, 0);
+    return chunk == NULL ? -1 : chunk->ids[gridIndex(x, y)];
+}
+
+// slot of address in table, or of the empty slot where it belongs
+static int addrSlot(u_int16_t address)
+{
+    int slot = (address * 40503u) & (addrSize - 1);
+    while (addrKeys[slot] != 0 && addrKeys[slot] != address)
+    {
+        slot = (slot + 1) & (addrSize - 1);
+    }
+    return slot;
+}
+
+static void addrInsert(u_int16_t address, int id)
+{
+    if ((addrCount + 1) * 2 > addrSize)
+    { // keep load factor below 1/2
+        u_int16_t *old_keys = addrKeys;
+        int *old_ids = addrIds;
+        int old_size = addrSize;
+        addrSize = addrSize == 0 ? SFDEVICE_ADDR_MIN : addrSize * 2;
+        addrKeys = calloc(addrSize, sizeof(u_int16_t));
+        addrIds = malloc(sizeof(int) * addrSize);
+        for (int i = 0; i < old_size; i++)
+        {
+            if (old_keys[i] != 0)
+            {
+                int slot = addrSlot(old_keys[i]);
+                addrKeys[slot] = old_keys[i];
+                addrIds[slot] = old_ids[i];
+            }
+        }
+        free(old_keys);
+        free(old_ids);
+    }
+    int slot = addrSlot(address);
+    addrCount += addrKeys[slot] == 0 ? 1 : 0;
+    addrKeys[slot] = address;
+    addrIds[slot] = id;
+}
+
+// delete address. Following entries of the probe sequence are moved up, so no
+// tombstones are needed
+static void addrDelete(u_int16_t address)
+{
+    if (addrSize == 0 || addrKeys[addrSlot(address)] == 0)
+    {
+        return;
+    }
+    int hole = addrSlot(address);
+    addrKeys[hole] = 0;
+    addrCount--;
+    for (int slot = (hole + 1) & (addrSize - 1); addrKeys[slot] != 0; slot = (slot + 1) & (addrSize - 1))
     {
-        for (int x = 0; x < SFDEVICE_MAX_X; x++)
+        int home = (addrKeys[slot] * 40503u) & (addrSize - 1);
+        // move entry if hole lies between its home slot and its slot
+        if (((slot - home) & (addrSize - 1)) >= ((slot - hole) & (addrSize - 1)))
         {
-            deviceMap[x][y] = -1; //all empty slots are -1
+            addrKeys[hole] = addrKeys[slot];
+            addrIds[hole] = addrIds[slot];
+            addrKeys[slot] = 0;
+            hole = slot;
         }
     }
-    for (int ix = 0; ix < SFDEVICE_MAXDEV; ix++)
+}
+
+// device id of bus address, -1 if no device is registered with this address
+int devicemgr_findAddress(u_int16_t address)
+{
+    if (addrSize == 0 || address == 0)
+    {
+        return -1;
+    }
+    int slot = addrSlot(address);
+    return addrKeys[slot] == 0 ? -1 : addrIds[slot];
+}
+
+void devicemgr_init(int fd)
+{
+    deviceFd = fd;
+    free(addrKeys);
+    free(addrIds);
+    addrKeys = NULL;
+    addrIds = NULL;
+    addrSize = 0;
+    addrCount = 0;
+    // release grid and clear device store
+    for (int i = 0; i < gridSize; i++)
+    {
+        free(gridTable[i]);
+    }
+    free(gridTable);
+    gridTable = NULL;
+    gridSize = 0;
+    gridChunks = 0;
+    gridWidth = 0;
+    gridHeight = 0;
+    for (int ix = 0; ix < deviceCapacity; ix++)
     {
         devices[ix].address = 0; // Adress 0 is only used for new units. should never be used for active unit
         devices[ix].deviceState = UNALLOCATED;
+        devices[ix].pos_x = -1;
+        devices[ix].pos_y = -1;
+        devices[ix].verify_pending = 0;
+    }
+    verifyCount = 0;
+    for (int i = 0; i < zoneCount; i++)
+    {
+        free(zones[i].ids);
     }
+    free(zones);
+    zones = NULL;
+    zoneCount = 0;
 }
 
-int devicemgr_readStatus(int device_id)
+/*
+ * Read status of device. window starts a new voltage window on the device, only
+ * the telemetry sampler does that, so its windows are not cut by other reads.
+ * returns 0 on success, -1 if the device did not respond, -2 if not defined
+ */
+static int readStatus(int device_id, u_int8_t window)
 {
     if (devices[device_id].address > 0)
     { // only if defined
         double _voltage = 0;
         u_int32_t _counter = 0;
-        u_int8_t _status =
-            sfbus_read_status(devices[device_id].rs485_descriptor, devices[device_id].address, &_voltage, &_counter);
+        u_int8_t _status = 0xFF;
+        struct SFBUS_STATUS status;
+        int res = -2;
+        u_int32_t now = sfbus_ticks_now();
+        if (devices[device_id].status_ext || (int32_t)(now - devices[device_id].ext_retry) >= 0)
+        {
+            res = sfbus_read_status_ext(devices[device_id].rs485_descriptor, devices[device_id].address, &status,
+                                        window);
+            if (res == 0)
+            {
+                devices[device_id].status_ext = 1;
+                devices[device_id].ext_fails = 0;
+            }
+            else if (res == -2 && (!devices[device_id].status_ext || ++devices[device_id].ext_fails >= SFDEVICE_EXT_FAILS))
+            { // old firmware or garbled replies, use basic status for a while
+                devices[device_id].status_ext = 0;
+                devices[device_id].ext_fails = 0;
+                devices[device_id].ext_retry = now + SFDEVICE_EXT_RETRY_MS * 1000LL / SFBUS_TICK_US;
+            }
+        }
+        if (res == 0)
+        {
+            _status = status.status;
+            _voltage = status.voltage;
+            _counter = status.counter;
+            devices[device_id].reg_voltage_min = status.voltage_min;
+            devices[device_id].reg_voltage_max = status.voltage_max;
+            devices[device_id].reg_voltage_avg = status.voltage_avg;
+            status.sags = window ? status.sags : 0; // counted by the read that ends the window
+            devices[device_id].reg_sags += status.sags;
+        }
+        else if (res == -2)
+        { // fallback for old firmware
+            _status = sfbus_read_status(
+                devices[device_id].rs485_descriptor, devices[device_id].address, &_voltage, &_counter);
+            devices[device_id].reg_voltage_min = _voltage;
+            devices[device_id].reg_voltage_max = _voltage;
+            devices[device_id].reg_voltage_avg = _voltage;
+        }
         if (_status == 0xFF)
         {
             devices[device_id].powerState = UNKNOWN;
             devices[device_id].deviceState = OFFLINE;
+            telemetry_offline(device_id);
             return -1;
         }
+        telemetry_record(device_id, devices[device_id].reg_voltage_min, devices[device_id].reg_voltage_avg,
+                         devices[device_id].reg_voltage_max, res == 0 ? status.sags : 0, _counter, _status);
+        // drift evidence: home error measured since last read, or home passes missed by the sensor.
+        // the counter is incremented on each home pass
+        if (devices[device_id].deviceState == ONLINE || devices[device_id].deviceState == FAILED)
+        {
+            u_int32_t passed = _counter - devices[device_id].reg_counter;
+            if ((_status & 0x01) && passed > 0)
+            {
+                devices[device_id].drift = 1;
+                devices[device_id].drift_events += devices[device_id].drift_events < 0xFF ? 1 : 0;
+            }
+            if (devices[device_id].home_expected >= 2 && passed == 0)
+            {
+                devices[device_id].drift = 1;
+            }
+        }
+        // tick counter of module restarts at 0 after a reset, it is aligned again before the next timed start
+        if ((_status & 0x80) || devices[device_id].deviceState == NEW || devices[device_id].deviceState == OFFLINE)
+        {
+            timeSyncDue = 1;
+        }
+        devices[device_id].home_expected = 0;
+        devices[device_id].reg_flap = res == 0 ? status.flap : -1;
+        if (devices[device_id].reg_flap >= 0 && devices[device_id].reg_flap < SFBUS_FLAPS && !(_status & 0x40) &&
+            (int32_t)(devices[device_id].busy_until - sfbus_ticks_now()) <= 0)
+        { // idle, measured position replaces the tracked one, see moveRequired
+            devices[device_id].current_flap = devices[device_id].reg_flap;
+        }
         devices[device_id].reg_voltage = _voltage;
         devices[device_id].reg_counter = _counter;
         devices[device_id].reg_status = _status;
@@ -111,6 +502,11 @@ int devicemgr_readStatus(int device_id)
     }
 }
 
+int devicemgr_readStatus(int device_id)
+{
+    return readStatus(device_id, 0);
+}
+
 int devicemgr_readCalib(int device_id)
 {
     if (devices[device_id].deviceState == ONLINE)
@@ -121,6 +517,12 @@ int devicemgr_readCalib(int device_id)
             uint16_t calib_data = (*(buffer_r + 2) & 0xFF | ((*(buffer_r + 3) << 8) & 0xFF00));
             devices[device_id].calibration = calib_data;
             free(buffer_r);
+            // per-flap calibration for travel time, not supported by old firmware
+            if (sfbus_read_flapcal(devices[device_id].rs485_descriptor, devices[device_id].address,
+                                   devices[device_id].flapcal) != 0)
+            {
+                memset(devices[device_id].flapcal, 0, SFBUS_FLAPS);
+            }
         }
         else
         {
@@ -138,12 +540,12 @@ int devicemgr_readCalib(int device_id)
 json_object *devicemgr_printMap()
 {
     json_object *rows_array = json_object_new_array();
-    for (int y = 0; y < SFDEVICE_MAX_Y; y++)
+    for (int y = 0; y < gridHeight; y++)
     {
         json_object *columns_array = json_object_new_array();
-        for (int x = 0; x < SFDEVICE_MAX_X; x++)
+        for (int x = 0; x < gridWidth; x++)
         {
-            json_object_array_add(columns_array, json_object_new_int(deviceMap[x][y]));
+            json_object_array_add(columns_array, json_object_new_int(devicemgr_lookup(x, y)));
         }
         json_object_array_add(rows_array, columns_array);
     }
@@ -152,12 +554,21 @@ json_object *devicemgr_printMap()
 
 void devicemgr_printDetails(int device_id, json_object *root)
 {
+    if (device_id < 0 || device_id >= deviceCapacity)
+    {
+        json_object_object_add(root, "error", json_object_new_string("device error"));
+        json_object_object_add(root, "detail", json_object_new_string("invalid id"));
+        return;
+    }
     // generate json object with status
     json_object_object_add(root, "id", json_object_new_int(device_id));
     json_object_object_add(root, "address", json_object_new_int(devices[device_id].address));
     json_object_object_add(root, "calibration", json_object_new_int(devices[device_id].calibration));
     json_object_object_add(root, "flapID", json_object_new_int(devices[device_id].current_flap));
     json_object_object_add(root, "flapChar", json_object_new_string(symbols[devices[device_id].current_flap]));
+    json_object_object_add(root, "movesSinceHome", json_object_new_int(devices[device_id].moves_since_home));
+    json_object_object_add(root, "driftSuspected", json_object_new_boolean(devices[device_id].drift));
+    json_object_object_add(root, "homeErrors", json_object_new_int(devices[device_id].drift_events));
     json_object *position = json_object_new_object();
     json_object_object_add(position, "x", json_object_new_int(devices[device_id].pos_x));
     json_object_object_add(position, "y", json_object_new_int(devices[device_id].pos_y));
@@ -165,6 +576,10 @@ void devicemgr_printDetails(int device_id, json_object *root)
 
     json_object *status = json_object_new_object();
     json_object_object_add(status, "voltage", json_object_new_double(devices[device_id].reg_voltage));
+    json_object_object_add(status, "voltageMin", json_object_new_double(devices[device_id].reg_voltage_min));
+    json_object_object_add(status, "voltageMax", json_object_new_double(devices[device_id].reg_voltage_max));
+    json_object_object_add(status, "voltageAvg", json_object_new_double(devices[device_id].reg_voltage_avg));
+    json_object_object_add(status, "sags", json_object_new_int64(devices[device_id].reg_sags));
     json_object_object_add(status, "rotations", json_object_new_int(devices[device_id].reg_counter));
     json_object_object_add(status, "power", json_object_new_boolean(devices[device_id].powerState));
     json_object_object_add(status, "raw", json_object_new_uint64(devices[device_id].reg_status));
@@ -220,7 +635,7 @@ void devicemgr_printDetailsAll(json_object *root)
     json_object_object_add(root, "devices_all", json_object_new_int(nextFreeSlot + 1));
     json_object *devices_arr = json_object_new_array();
     int devices_online = 0;
-    for (int i = 0; i < (nextFreeSlot + 1); i++)
+    for (int i = 0; i < (nextFreeSlot + 1) && i < deviceCapacity; i++)
     {
         if (devices[i].address > 0)
         {
@@ -239,9 +654,9 @@ void devicemgr_printDetailsAll(json_object *root)
     json_object_object_add(root, "devices_online", json_object_new_int(devices_online));
 }
 
-void setSingle(int id, char flap)
+// convert char to flap id. returns -1 if there is no matching flap
+int findFlap(char flap)
 {
-    // first convert char to flap id
     char test_char = toupper(flap);
     printf("find char %c\n", test_char);
     for (int ix = 0; ix < 45; ix++)
@@ -249,180 +664,1976 @@ void setSingle(int id, char flap)
         if (*symbols[ix] == test_char)
         {
             printf("match char %i %i %i\n", test_char, *symbols[ix], ix);
-            sfbus_display_full(devices[id].rs485_descriptor, devices[id].address, ix);
-            break;
+            return ix;
         }
     }
-    devices[nextFreeSlot].current_flap = flap;
+    return -1;
 }
 
-void setSingleRaw(int id, int flap)
+// position of flap in steps after home, without offset
+static int flapPos(int id, int flap)
 {
-    sfbus_display_full(devices[id].rs485_descriptor, devices[id].address, flap);
-    devices[nextFreeSlot].current_flap = flap;
+    return flap * SFDEVICE_STEPS_PER_FLAP + devices[id].flapcal[flap];
 }
 
-void devicemgr_printText(char *text, int x, int y)
+// steps between two flaps. Drums only turn forward
+static int flapSteps(int id, int from, int to)
 {
-    for (int i = 0; i < strlen(text); i++)
-    {
-        int this_id = deviceMap[x + i][y];
-        if (this_id >= 0)
-        {
-            printf("print char %c to %i\n", *(text + i), devices[this_id].address);
+    return (flapPos(id, to) - flapPos(id, from) + SFDEVICE_STEPS_PER_REV) % SFDEVICE_STEPS_PER_REV;
+}
 
-            setSingle(this_id, *(text + i));
-        }
+// travel time of device from its current flap to the target in ticks (one
+// step per tick). A full rotation moves to the flap before the current one
+// first and switches to the target one tick later
+int moveTicks(int id, int to, int fullRotation)
+{
+    int from = devices[id].current_flap % SFBUS_FLAPS;
+    if (!fullRotation)
+    {
+        return flapSteps(id, from, to);
     }
+    int before = (from + SFBUS_FLAPS - 1) % SFBUS_FLAPS;
+    return flapSteps(id, from, before) + 1 + flapSteps(id, before, to);
 }
 
-void devicemgr_printFlap(int flap, int x, int y)
+/*
+ * Decide if the move of a device is a full rotation. Auto moves are direct
+ * unless the module is likely out of calibration: the firmware reported a
+ * home error or no home, the rotation counter did not advance although
+ * home was passed, or too many direct moves did not pass home. Each home
+ * error halves the amount of direct moves allowed.
+ */
+static int moveFull(int id, int fullRotation)
 {
-    int this_id = deviceMap[x][y];
-    if (this_id >= 0)
+    if (fullRotation != SFDEVICE_MOVE_AUTO)
     {
-        setSingleRaw(this_id, flap);
+        return fullRotation != SFDEVICE_MOVE_DIRECT;
     }
+    int shift = devices[id].drift_events < SFDEVICE_DRIFT_SHIFT_MAX ? devices[id].drift_events
+                                                                    : SFDEVICE_DRIFT_SHIFT_MAX;
+    return devices[id].drift || (devices[id].reg_status & 0x02) ||
+           devices[id].moves_since_home >= (SFDEVICE_DRIFT_MOVES >> shift);
 }
 
-int devicemgr_register(int rs485_descriptor, u_int16_t address, int x, int y, int nid)
+// check if move needs to be sent, a full rotation is sent even if the flap is shown.
+// current_flap is the measured position of an idle device (firmware with position
+// readback, see readStatus), else the target of the last move
+static int moveRequired(int id, int flap, int fullRotation)
 {
-    if (nid < 0)
+    return fullRotation == SFDEVICE_MOVE_FULL || devices[id].current_flap != flap;
+}
+
+// update drift evidence of device before move from current flap. The module
+// recalibrates on each pass of the home sensor
+static void trackMove(int id, int to, int full)
+{
+    int offset = devices[id].calibration < SFDEVICE_OFFSET_MIN ? SFDEVICE_OFFSET_DEF : devices[id].calibration;
+    int from = (offset + flapPos(id, devices[id].current_flap % SFBUS_FLAPS)) % SFDEVICE_STEPS_PER_REV;
+    int passes = (from + moveTicks(id, to, full)) / SFDEVICE_STEPS_PER_REV;
+    devices[id].home_expected += passes;
+    if (full)
     {
-        nextFreeSlot++;
-        nid = nextFreeSlot;
+        devices[id].drift = 0;
     }
-
-    devices[nid].pos_x = x;
-    devices[nid].pos_y = y;
-    devices[nid].address = address;
-    devices[nid].calibration = 0;
-    devices[nid].rs485_descriptor = rs485_descriptor;
-    devices[nid].reg_voltage = 0;
-    devices[nid].reg_counter = 0;
-    devices[nid].reg_status = 0;
-    devices[nid].current_flap = 0;
-    devices[nid].deviceState = NEW;
-    devices[nid].powerState = DISABLED;
-    // try to reach device
-    devicemgr_readStatus(nid);
-    devicemgr_readCalib(nid);
-    if (deviceMap[x][y] >= 0)
-    { // rest old ones
-        int old_id = deviceMap[x][y];
-        devices[old_id].pos_x = -1;
-        devices[old_id].pos_y = -1;
+    if (passes > 0)
+    {
+        devices[id].moves_since_home = 0;
+    }
+    else if (devices[id].moves_since_home < 0xFFFF)
+    {
+        devices[id].moves_since_home++;
     }
-    deviceMap[x][y] = nid;
-    return nid;
 }
 
-// refreshes status of all devices
-int devicemgr_refresh()
+// check move of device after it ended, see devicemgr_verify. Replaces check of previous move
+static void verifyArm(int id, int flap, int full)
 {
-    int devices_online = 0;
-    for (int ix = 0; ix < SFDEVICE_MAXDEV; ix++)
+    struct SFDEVICE *device = &devices[id];
+    device->verify_flap = flap;
+    device->verify_full = full;
+    device->verify_resend = 0;
+    device->verify_retries = 0;
+    device->verify_at = device->busy_until + SFDEVICE_VERIFY_MARGIN_MS * 1000 / SFBUS_TICK_US;
+    device->verify_deadline = device->verify_at + SFDEVICE_ROTATION_TIMEOUT * 1000 / SFBUS_TICK_US;
+    device->verify_counter = device->reg_counter + (full ? 1 : 0);
+    if (device->verify_pending)
     {
-        if (devices[ix].address > 0)
+        return;
+    }
+    if (verifyCount == verifyCapacity)
+    {
+        int capacity = verifyCapacity < SFDEVICE_STORE_MIN ? SFDEVICE_STORE_MIN : verifyCapacity * 2;
+        int *queue = realloc(verifyQueue, sizeof(int) * capacity);
+        if (queue == NULL)
         {
-            devicemgr_readStatus(ix);
-            if (devices[ix].deviceState == ONLINE)
-            {
-                devices_online++;
-            }
+            return;
         }
+        verifyQueue = queue;
+        verifyCapacity = capacity;
     }
-    return devices_online;
+    verifyQueue[verifyCount++] = id;
+    device->verify_pending = 1;
 }
 
-// remove devices from system
-int devicemgr_remove(int id)
+// display flap on device directly. returns travel time in ticks
+int setSingle(int id, char flap, int fullRotation)
 {
-    devices[nextFreeSlot].deviceState = REMOVED;
-    devices[nextFreeSlot].address = 0;
-    devices[nextFreeSlot].rs485_descriptor = NULL;
-    return 0;
+    int ix = findFlap(flap);
+    if (ix < 0)
+    {
+        return 0;
+    }
+    fullRotation = moveFull(id, fullRotation);
+    trackMove(id, ix, fullRotation);
+    int ticks = moveTicks(id, ix, fullRotation);
+    if (fullRotation)
+    {
+        sfbus_display_full(devices[id].rs485_descriptor, devices[id].address, ix);
+    }
+    else
+    {
+        sfbus_display(devices[id].rs485_descriptor, devices[id].address, ix);
+    }
+    devices[id].busy_until = sfbus_ticks_now() + ticks;
+    devices[id].current_flap = ix;
+    verifyArm(id, ix, fullRotation);
+    verifier_kick();
+    return ticks;
 }
 
-int devicemgr_save(char *file)
+// stage current flap of device with next sequence number. Scheduled devices
+// start at their start tick, all others at the next commit
+void stageSeq(int id)
 {
-    json_object *root = json_object_new_object();
-    json_object_object_add(root, "nextFreeSlot", json_object_new_int(nextFreeSlot));
-    json_object *device_array = json_object_new_array();
-    for (int ix = 0; ix < SFDEVICE_MAXDEV; ix++)
+    devices[id].seq_last++;
+    if (devices[id].start_timed)
     {
-        if (devices[ix].address > 0)
-        {
-            json_object *device = json_object_new_object();
-            devicemgr_printDetails(ix, device);
-            json_object_array_add(device_array, device);
-        }
+        sfbus_display_at_seq(devices[id].rs485_descriptor, devices[id].address, devices[id].current_flap,
+                             devices[id].full_rotation, devices[id].start_tick, devices[id].seq_last);
+    }
+    else
+    {
+        sfbus_stage_seq(devices[id].rs485_descriptor, devices[id].address, devices[id].current_flap,
+                        devices[id].full_rotation, devices[id].seq_last);
     }
-
-    json_object_object_add(root, "devices", device_array);
-
-    char *data = json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY);
-    printf("[INFO][console] store data to %s\n", file);
-
-    FILE *fptr;
-    fptr = fopen(file, "w");
-    fwrite(data, sizeof(char), strlen(data), fptr);
-    fclose(fptr);
 }
 
-int devicemgr_load(char *file)
+// check if a move of slots fits into the power budget when started at start.
+// Slots without other moving devices always fit, so a device is started even
+// if it exceeds the budget alone
+static int startFits(int *load, int *base, int start, int slots, int inrush_slots)
 {
-    FILE *fptr;
-    const char *line_in_file = malloc(JSON_MAX_LINE_LEN); // maximum of 256 bytes per line;
-    fptr = fopen(file, "r");
-    json_tokener *tok = json_tokener_new();
-    json_object *jobj = NULL;
-    int stringlen = 0;
-    enum json_tokener_error jerr;
-
-    do
+    for (int slot = start; slot < start + slots; slot++)
     {
-        int read_ret = fgets(line_in_file, JSON_MAX_LINE_LEN, fptr); // read line from file
-        stringlen = strlen(line_in_file);
-        // printf("Read line with chars: %i : %s", stringlen, line_in_file); // only for testing
-        jobj = json_tokener_parse_ex(tok, line_in_file, stringlen);
-        if (read_ret == NULL)
+        int extra = power.run_ma - power.hold_ma + (slot - start < inrush_slots ? power.inrush_ma : 0);
+        if (power.budget_ma > 0 && load[slot] + extra > power.budget_ma && load[slot] != base[slot])
         {
-            break;
+            return 0;
         }
-    } while ((jerr = json_tokener_get_error(tok)) == json_tokener_continue);
-    if (jerr != json_tokener_success)
-    {
-        free(fptr); //free file pointer
-        fprintf(stderr, "Error: %s\n", json_tokener_error_desc(jerr));
-        // Handle errors, as appropriate for your application.
-        return -1;
     }
+    return 1;
+}
 
-    // cleanup
-    free(fptr); //free file pointer
-    free(tok);  //free tokenizer
+static void startAdd(int *load, int start, int slots, int inrush_slots)
+{
+    for (int slot = start; slot < start + slots; slot++)
+    {
+        load[slot] += power.run_ma - power.hold_ma + (slot - start < inrush_slots ? power.inrush_ma : 0);
+    }
+}
 
-    // dump loadad data to terminal ( for tetsting)
-    // char *data = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
-    // printf("%s",data);
+// time slots needed to send and confirm the stage commands of count devices
+static int leadSlots(int count)
+{
+    u_int32_t frames_us = count * sfbus_frame_time_us(9) * (SFDEVICE_SEQ_RETRIES + 1);
+    u_int32_t confirm_us = (SFDEVICE_SEQ_RETRIES + 1) * (count * SFBUS_SEQ_SLOT_MS + 50) * 1000;
+    return (frames_us + confirm_us + SFDEVICE_SCHED_LEAD_MS * 1000) / SFBUS_TICK_US / SFDEVICE_SCHED_SLOT_TICKS + 1;
+}
 
-    // load data
-    json_object *next_free;
-    if (!json_object_object_get_ex(jobj, "nextFreeSlot", &next_free))
+/*
+ * Schedule the moves of the devices, so all devices arrive at the same time.
+ * Every device gets a start tick for display at, derived from its travel time
+ * (see moveTicks). flaps holds the new flap of each device.
+ * If target is set (bus time), the devices arrive at target instead of as
+ * early as possible. A target that cannot be reached is replaced by the
+ * earliest possible arrival.
+ * The current of all modules on a bus is kept within power.budget_ma: starts
+ * whose inrush does not fit are moved forward, if not all devices of a bus can
+ * move at once, they are started one after another as early as possible,
+ * longest moves first. Powered down devices are switched on in batches first,
+ * idle devices not in the update are powered off if power.power_off_idle is set.
+ * delays (ticks, may be NULL) start a device later than the others, its start
+ * is placed on the timeline with the delay, so it counts against the budget.
+ * returns bus time of the last expected stop.
+ */
+u_int32_t scheduleStarts(int *ids, u_int8_t *flaps, u_int16_t *delays, int count, u_int32_t target)
+{
+    devicemgr_timeSync(0);
+    u_int8_t *in_update = calloc(deviceCapacity, 1);
+    for (int i = 0; i < count; i++)
     {
-        fprintf(stderr, "Error: %s\n", "Key 'nextFreeSlot' not found.");
-        return -1;
+        in_update[ids[i]] = 1;
     }
-    else
+    int lead_slots = leadSlots(count);
+    int inrush_slots =
+        (power.inrush_ms * 1000 / SFBUS_TICK_US + SFDEVICE_SCHED_SLOT_TICKS - 1) / SFDEVICE_SCHED_SLOT_TICKS;
+    u_int32_t last_stop = sfbus_ticks_now();
+    u_int8_t *done = calloc(count, 1);
+    int *order = malloc(sizeof(int) * count);
+    int *ticks = malloc(sizeof(int) * count);
+    int *start_rel = malloc(sizeof(int) * count); // start ticks relative to now
+    int *late = malloc(sizeof(int) * count);      // delay of start in ticks
+    for (int b = 0; b < count; b++)
     {
-        nextFreeSlot = json_object_get_int(next_free);
+        if (done[b])
+        {
+            continue;
+        }
+        int bus = devices[ids[b]].rs485_descriptor;
+        // power off idle devices, sum up current of powered devices
+        u_int32_t now = sfbus_ticks_now();
+        int baseline = 0;
+        for (int ix = 0; ix < deviceCapacity; ix++)
+        {
+            if (devices[ix].address == 0 || devices[ix].deviceState != ONLINE ||
+                devices[ix].rs485_descriptor != bus || devices[ix].powerState == DISABLED)
+            {
+                continue;
+            }
+            if (power.power_off_idle && !in_update[ix] && (int32_t)(devices[ix].busy_until - now) <= 0)
+            {
+                sfbus_motor_power(bus, devices[ix].address, 0);
+                devices[ix].powerState = DISABLED;
+                continue;
+            }
+            baseline += power.hold_ma;
+        }
+        // power on devices of update in batches
+        int batch = count;
+        if (power.budget_ma > 0)
+        {
+            batch = (power.budget_ma - baseline) / (power.inrush_ma + power.hold_ma);
+            batch = batch < 1 ? 1 : batch;
+        }
+        int powered = 0;
+        for (int i = b; i < count; i++)
+        {
+            if (devices[ids[i]].rs485_descriptor != bus || devices[ids[i]].powerState == ENABLED)
+            {
+                continue;
+            }
+            sfbus_motor_power(bus, devices[ids[i]].address, 1);
+            devices[ids[i]].powerState = ENABLED;
+            baseline += power.hold_ma;
+            if (++powered % batch == 0)
+            {
+                tcdrain(bus);
+                usleep(power.inrush_ms * 1000);
+            }
+        }
+        if (powered % batch != 0)
+        {
+            tcdrain(bus);
+            usleep(power.inrush_ms * 1000);
+        }
+
+        // devices of this bus, longest move first
+        int ordered = 0;
+        int running = baseline;
+        int late_max = 0;
+        for (int i = b; i < count; i++)
+        {
+            if (devices[ids[i]].rs485_descriptor != bus)
+            {
+                continue;
+            }
+            done[i] = 1;
+            ticks[i] = moveTicks(ids[i], flaps[i], devices[ids[i]].full_rotation);
+            late[i] = delays != NULL ? delays[i] : 0;
+            late_max = late[i] > late_max ? late[i] : late_max;
+            running += power.run_ma - power.hold_ma;
+            int pos = ordered++;
+            while (pos > 0 && ticks[order[pos - 1]] < ticks[i])
+            {
+                order[pos] = order[pos - 1];
+                pos--;
+            }
+            order[pos] = i;
+        }
+
+        // timeline of bus current, slot 0 starts now
+        now = sfbus_ticks_now();
+        int target_rel = target != 0 && (int32_t)(target - now) > 0 ? (int32_t)(target - now) : 0;
+        int horizon = lead_slots + inrush_slots + 2 + target_rel / SFDEVICE_SCHED_SLOT_TICKS;
+        horizon += late_max / SFDEVICE_SCHED_SLOT_TICKS + 1;
+        for (int o = 0; o < ordered; o++)
+        {
+            horizon += (ticks[order[o]] + late[order[o]]) / SFDEVICE_SCHED_SLOT_TICKS + 1;
+        }
+        int *base = malloc(sizeof(int) * horizon);
+        int *load = malloc(sizeof(int) * horizon);
+        for (int slot = 0; slot < horizon; slot++)
+        {
+            base[slot] = baseline;
+        }
+        for (int ix = 0; ix < deviceCapacity; ix++)
+        { // devices still moving from last update
+            int32_t remaining = (int32_t)(devices[ix].busy_until - now);
+            if (devices[ix].address == 0 || devices[ix].rs485_descriptor != bus || remaining <= 0 ||
+                in_update[ix] || devices[ix].powerState != ENABLED)
+            {
+                continue;
+            }
+            for (int slot = 0; slot < horizon && slot * SFDEVICE_SCHED_SLOT_TICKS < remaining; slot++)
+            {
+                base[slot] += power.run_ma - power.hold_ma;
+            }
+        }
+
+        // synchronized arrival, if all devices can move at once
+        int sync = power.budget_ma == 0 || running <= power.budget_ma;
+        int arrival = lead_slots * SFDEVICE_SCHED_SLOT_TICKS + ticks[order[0]];
+        arrival = target_rel > arrival ? target_rel : arrival;
+        while (sync)
+        {
+            int placed = 1;
+            memcpy(load, base, sizeof(int) * horizon);
+            for (int o = 0; o < ordered && placed; o++)
+            {
+                int i = order[o];
+                int stop = arrival + late[i];
+                int start = (stop - ticks[i]) / SFDEVICE_SCHED_SLOT_TICKS;
+                int slots = stop / SFDEVICE_SCHED_SLOT_TICKS - start + 1;
+                start_rel[i] = stop - ticks[i];
+                while (start >= lead_slots && !startFits(load, base, start, slots, inrush_slots))
+                { // start earlier, arrives a few slots before the others
+                    start--;
+                    start_rel[i] = start * SFDEVICE_SCHED_SLOT_TICKS;
+                }
+                placed = start >= lead_slots;
+                if (placed)
+                {
+                    startAdd(load, start, slots, inrush_slots);
+                }
+            }
+            if (placed)
+            {
+                break;
+            }
+            arrival += SFDEVICE_SCHED_SLOT_TICKS;
+            sync = (arrival + late_max) / SFDEVICE_SCHED_SLOT_TICKS + 1 < horizon;
+        }
+        if (!sync)
+        { // one after another, as early as possible
+            memcpy(load, base, sizeof(int) * horizon);
+            for (int o = 0; o < ordered; o++)
+            {
+                int i = order[o];
+                int slots = ticks[i] / SFDEVICE_SCHED_SLOT_TICKS + 1;
+                int start = lead_slots + late[i] / SFDEVICE_SCHED_SLOT_TICKS;
+                while (start + slots < horizon && !startFits(load, base, start, slots, inrush_slots))
+                {
+                    start++;
+                }
+                startAdd(load, start, start + slots < horizon ? slots : horizon - start, inrush_slots);
+                start_rel[i] = start * SFDEVICE_SCHED_SLOT_TICKS;
+            }
+            // delay the whole sequence, so the last device arrives at target
+            int last = 0;
+            for (int o = 0; o < ordered; o++)
+            {
+                last = start_rel[order[o]] + ticks[order[o]] > last ? start_rel[order[o]] + ticks[order[o]] : last;
+            }
+            int delay = (target_rel - last) / SFDEVICE_SCHED_SLOT_TICKS * SFDEVICE_SCHED_SLOT_TICKS;
+            for (int o = 0; o < ordered && delay > 0; o++)
+            {
+                start_rel[order[o]] += delay;
+            }
+        }
+        for (int o = 0; o < ordered; o++)
+        {
+            int i = order[o];
+            struct SFDEVICE *device = &devices[ids[i]];
+            device->start_timed = 1;
+            device->start_tick = now + start_rel[i];
+            device->busy_until = device->start_tick + ticks[i];
+            if ((int32_t)(device->busy_until - last_stop) > 0)
+            {
+                last_stop = device->busy_until;
+            }
+        }
+        free(base);
+        free(load);
+    }
+    free(in_update);
+    free(done);
+    free(order);
+    free(ticks);
+    free(start_rel);
+    free(late);
+    printf("[INFO][devicemgr] scheduled %i devices, last stop in %i ms\n", count,
+           (int)((int32_t)(last_stop - sfbus_ticks_now()) * (SFBUS_TICK_US / 1000.0)));
+    return last_stop;
+}
+
+// confirm that staged flaps were received. Devices that did not apply their
+// last sequence number are staged again. returns amount of unconfirmed devices
+int confirmStaged(int *ids, int count)
+{
+    int missing = 0;
+    for (int retry = 0; retry <= SFDEVICE_SEQ_RETRIES; retry++)
+    {
+        missing = 0;
+        u_int8_t *done = calloc(count, 1);
+        int remaining = count;
+        while (remaining > 0)
+        {
+            // query the range starting at the lowest address not checked yet
+            u_int16_t base = 0xFFFF;
+            for (int i = 0; i < count; i++)
+            {
+                if (done[i] == 0 && devices[ids[i]].address < base)
+                {
+                    base = devices[ids[i]].address;
+                }
+            }
+            struct SFBUS_SEQSTATE states[SFBUS_SEQ_MAXSLOTS];
+            u_int8_t slots = 1;
+            for (int i = 0; i < count; i++)
+            {
+                u_int16_t offset = devices[ids[i]].address - base;
+                if (done[i] == 0 && offset < SFBUS_SEQ_MAXSLOTS && offset + 1 > slots)
+                {
+                    slots = offset + 1;
+                }
+            }
+            sfbus_seq_collect(deviceFd, base, slots, states);
+            for (int i = 0; i < count; i++)
+            {
+                u_int16_t offset = devices[ids[i]].address - base;
+                if (done[i] != 0 || offset >= slots)
+                {
+                    continue;
+                }
+                done[i] = 1;
+                remaining--;
+                if (sfbus_seq_applied(&states[offset], devices[ids[i]].seq_last) == 0)
+                {
+                    missing++;
+                    if (retry < SFDEVICE_SEQ_RETRIES)
+                    {
+                        stageSeq(ids[i]);
+                    }
+                }
+            }
+        }
+        free(done);
+        if (missing == 0)
+        {
+            break;
+        }
+        fprintf(stderr, "[WARN][devicemgr] %i stage commands lost\n", missing);
+    }
+    return missing;
+}
+
+void setSingleRaw(int id, int flap)
+{
+    sfbus_display_full(devices[id].rs485_descriptor, devices[id].address, flap);
+    devices[id].busy_until = sfbus_ticks_now() + moveTicks(id, flap, 1);
+    devices[id].current_flap = flap;
+}
+
+/*
+ * Print cells. All cells are scheduled to arrive at the same time (see
+ * scheduleStarts), at bus time arrival if set. A cell with delay (ticks)
+ * starts and arrives this much later. delays may be NULL.
+ * returns time in ms until all cells have arrived.
+ */
+static int printCells(int *ids, u_int8_t *flaps, u_int16_t *delays, int count, int fullRotation, u_int32_t arrival)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    // timed starts are only needed for a power budget, an arrival target or delayed cells
+    int timed = power.budget_ma > 0 || arrival != 0;
+    for (int i = 0; i < count; i++)
+    {
+        devices[ids[i]].full_rotation = moveFull(ids[i], fullRotation);
+        trackMove(ids[i], flaps[i], devices[ids[i]].full_rotation);
+        timed |= delays != NULL && delays[i] > 0;
+    }
+    if (timed)
+    {
+        arrival = scheduleStarts(ids, flaps, delays, count, arrival);
+    }
+    else
+    { // stage all, then start all devices at once with a single commit
+        arrival = sfbus_ticks_now();
+        for (int i = 0; i < count; i++)
+        {
+            struct SFDEVICE *device = &devices[ids[i]];
+            if (device->powerState == DISABLED)
+            {
+                sfbus_motor_power(device->rs485_descriptor, device->address, 1);
+                device->powerState = ENABLED;
+            }
+            device->start_timed = 0;
+            device->busy_until = sfbus_ticks_now() + moveTicks(ids[i], flaps[i], device->full_rotation);
+            arrival = (int32_t)(device->busy_until - arrival) > 0 ? device->busy_until : arrival;
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        struct SFDEVICE *device = &devices[ids[i]];
+        device->current_flap = flaps[i];
+        stageSeq(ids[i]);
+    }
+    confirmStaged(ids, count);
+    if (!timed)
+    {
+        sfbus_commit(deviceFd);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        verifyArm(ids[i], flaps[i], devices[ids[i]].full_rotation);
+    }
+    verifier_kick();
+    int32_t eta = (int32_t)(arrival - sfbus_ticks_now());
+    return eta > 0 ? (eta * SFBUS_TICK_US) / 1000 : 0;
+}
+
+/*
+ * Print text at position. All changed cells are scheduled to arrive at the
+ * same time (see scheduleStarts), at bus time arrival if set. Without full
+ * rotation, cells that already show their character are not moved.
+ * returns time in ms until all cells have arrived.
+ */
+int devicemgr_printText(char *text, int x, int y, int fullRotation, u_int32_t arrival)
+{
+    int length = strlen(text);
+    int cells = 0;
+    for (int i = 0; i < length; i++)
+    {
+        if (devicemgr_lookup(x + i, y) >= 0)
+        {
+            cells++;
+        }
+    }
+    if (cells < 2 && arrival == 0)
+    {
+        // single cell, display directly
+        int ticks = 0;
+        for (int i = 0; i < length; i++)
+        {
+            int this_id = devicemgr_lookup(x + i, y);
+            if (this_id >= 0)
+            {
+                printf("print char %c to %i\n", *(text + i), devices[this_id].address);
+                ticks = setSingle(this_id, *(text + i), fullRotation);
+            }
+        }
+        return (ticks * SFBUS_TICK_US) / 1000;
+    }
+    // multiple cells: stage all with their start tick, resend lost stage commands
+    int staged = 0;
+    int *staged_ids = malloc(sizeof(int) * length);
+    u_int8_t *staged_flaps = malloc(length);
+    for (int i = 0; i < length; i++)
+    {
+        int this_id = devicemgr_lookup(x + i, y);
+        int ix = findFlap(*(text + i));
+        if (this_id >= 0 && ix >= 0 && moveRequired(this_id, ix, fullRotation))
+        {
+            printf("stage char %c to %i\n", *(text + i), devices[this_id].address);
+            staged_ids[staged] = this_id;
+            staged_flaps[staged++] = ix;
+        }
+    }
+    int eta = printCells(staged_ids, staged_flaps, NULL, staged, fullRotation, arrival);
+    free(staged_ids);
+    free(staged_flaps);
+    return eta;
+}
+
+// collect cells of frame that have to move. delays are converted to ticks.
+// ids, flaps and delays hold count entries. returns amount of cells
+static int frameCells(struct SFDEVICE_CELL *cells, int count, int fullRotation, int *ids, u_int8_t *flaps,
+                      u_int16_t *delays)
+{
+    int moving = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int this_id = devicemgr_lookup(cells[i].x, cells[i].y);
+        if (this_id < 0 || cells[i].flap >= SFBUS_FLAPS ||
+            !moveRequired(this_id, cells[i].flap, fullRotation))
+        {
+            continue;
+        }
+        ids[moving] = this_id;
+        flaps[moving] = cells[i].flap;
+        delays[moving++] = cells[i].delay_ms * 1000 / SFBUS_TICK_US;
+    }
+    return moving;
+}
+
+/*
+ * Print frame. Each cell arrives its delay after arrival, cells without
+ * device are ignored.
+ * returns time in ms until all cells have arrived.
+ */
+int devicemgr_printFrame(struct SFDEVICE_CELL *cells, int count, int fullRotation, u_int32_t arrival)
+{
+    int *ids = malloc(sizeof(int) * count);
+    u_int8_t *flaps = malloc(count);
+    u_int16_t *delays = malloc(sizeof(u_int16_t) * count);
+    int moving = frameCells(cells, count, fullRotation, ids, flaps, delays);
+    int eta = printCells(ids, flaps, delays, moving, fullRotation, arrival);
+    free(ids);
+    free(flaps);
+    free(delays);
+    return eta;
+}
+
+/*
+ * Estimate time in ms printCells needs to print the cells: sending and
+ * confirming the stage commands, powering on devices, waiting for devices
+ * still moving and the longest move. If the power budget does not allow all
+ * moves at once, the moves are assumed to be spread evenly.
+ */
+static int cellsDuration(int *ids, u_int8_t *flaps, u_int16_t *delays, int count, int fullRotation)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    int lead_ticks = leadSlots(count) * SFDEVICE_SCHED_SLOT_TICKS;
+    u_int32_t now = sfbus_ticks_now();
+    int powered_off = 0;
+    int max_ticks = 0;
+    int sum_ticks = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int ticks = moveTicks(ids[i], flaps[i], moveFull(ids[i], fullRotation));
+        int32_t busy = (int32_t)(devices[ids[i]].busy_until - now);
+        int ready = busy > lead_ticks ? busy : lead_ticks;
+        int end = ready + ticks + (delays == NULL ? 0 : delays[i]);
+        max_ticks = end > max_ticks ? end : max_ticks;
+        sum_ticks += ticks;
+        powered_off += devices[ids[i]].powerState != ENABLED ? 1 : 0;
+    }
+    int ms = powered_off > 0 ? power.inrush_ms : 0;
+    if (power.budget_ma > 0 && count * power.run_ma > power.budget_ma)
+    {
+        int parallel = power.budget_ma / (power.run_ma + power.inrush_ma);
+        parallel = parallel < 1 ? 1 : parallel;
+        max_ticks = lead_ticks + sum_ticks / parallel > max_ticks ? lead_ticks + sum_ticks / parallel : max_ticks;
+        ms = powered_off * power.inrush_ms / parallel;
+    }
+    ms += max_ticks * (SFBUS_TICK_US / 1000.0);
+    return ms;
+}
+
+// estimate time in ms devicemgr_printText needs to print the text
+int devicemgr_printDuration(char *text, int x, int y, int fullRotation)
+{
+    int length = strlen(text);
+    int count = 0;
+    int *ids = malloc(sizeof(int) * length);
+    u_int8_t *flaps = malloc(length);
+    for (int i = 0; i < length; i++)
+    {
+        int this_id = devicemgr_lookup(x + i, y);
+        int ix = findFlap(*(text + i));
+        if (this_id >= 0 && ix >= 0 && moveRequired(this_id, ix, fullRotation))
+        {
+            ids[count] = this_id;
+            flaps[count++] = ix;
+        }
+    }
+    int duration = cellsDuration(ids, flaps, NULL, count, fullRotation);
+    free(ids);
+    free(flaps);
+    return duration;
+}
+
+// estimate time in ms devicemgr_printFrame needs to print the frame
+int devicemgr_frameDuration(struct SFDEVICE_CELL *cells, int count, int fullRotation)
+{
+    int *ids = malloc(sizeof(int) * count);
+    u_int8_t *flaps = malloc(count);
+    u_int16_t *delays = malloc(sizeof(u_int16_t) * count);
+    int moving = frameCells(cells, count, fullRotation, ids, flaps, delays);
+    int duration = cellsDuration(ids, flaps, delays, moving, fullRotation);
+    free(ids);
+    free(flaps);
+    free(delays);
+    return duration;
+}
+
+// exclusive access to devices and bus, held while a command is processed
+void devicemgr_lock()
+{
+    pthread_mutex_lock(&busLock);
+}
+
+void devicemgr_unlock()
+{
+    pthread_mutex_unlock(&busLock);
+}
+
+void devicemgr_printFlap(int flap, int x, int y)
+{
+    int this_id = devicemgr_lookup(x, y);
+    if (this_id >= 0)
+    {
+        setSingleRaw(this_id, flap);
+    }
+}
+
+// wait until no online device is busy. returns 0 when idle, -1 on timeout
+int devicemgr_waitIdle(int timeout_ms)
+{
+    while (timeout_ms > 0)
+    {
+        usleep(SFDEVICE_IDLE_POLL_MS * 1000);
+        timeout_ms -= SFDEVICE_IDLE_POLL_MS;
+        int busy = 0;
+        for (int ix = 0; ix < deviceCapacity; ix++)
+        {
+            if (devices[ix].address > 0 && devices[ix].deviceState == ONLINE)
+            {
+                devicemgr_readStatus(ix);
+                busy += (devices[ix].reg_status >> 6) & 0x01;
+            }
+        }
+        if (busy == 0)
+        {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Calibrate all online devices at once. Every device does the given number of
+ * full rotations, then its home error history is read. The mean delta is the
+ * difference between the real steps per revolution and the steps assumed by
+ * the firmware. It is distributed over the flaps and written as per-flap
+ * calibration table. returns number of calibrated devices.
+ */
+int devicemgr_calibrate(int rounds, int overwrite, json_object *root)
+{
+    int16_t deltas[SFBUS_ERROR_DATASETS];
+    // power on and clear error history
+    for (int ix = 0; ix < deviceCapacity; ix++)
+    {
+        if (devices[ix].address > 0 && devices[ix].deviceState == ONLINE)
+        {
+            struct SFBUS_MULTI multi;
+            char response[256];
+            sfbus_multi_init(&multi, devices[ix].address);
+            sfbus_multi_add(&multi, "\x21", 1);     // power on
+            sfbus_multi_add(&multi, "\xF9\x01", 2); // read and clear error history
+            sfbus_multi_send(devices[ix].rs485_descriptor, &multi, response);
+        }
+    }
+    // rotate all devices at once
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int ix = 0; ix < deviceCapacity; ix++)
+        {
+            if (devices[ix].address > 0 && devices[ix].deviceState == ONLINE)
+            {
+                trackMove(ix, devices[ix].current_flap, 1);
+                sfbus_stage(devices[ix].rs485_descriptor, devices[ix].address, devices[ix].current_flap, 1);
+            }
+        }
+        sfbus_commit(deviceFd);
+        if (devicemgr_waitIdle(SFDEVICE_ROTATION_TIMEOUT) < 0)
+        {
+            fprintf(stderr, "[WARN][devicemgr] calibration: devices still busy after timeout\n");
+        }
+    }
+    // evaluate and write calibration
+    int calibrated = 0;
+    json_object *results = json_object_new_array();
+    for (int ix = 0; ix < deviceCapacity; ix++)
+    {
+        if (devices[ix].address == 0 || devices[ix].deviceState != ONLINE)
+        {
+            continue;
+        }
+        json_object *result = json_object_new_object();
+        json_object_object_add(result, "id", json_object_new_int(ix));
+        json_object_object_add(result, "address", json_object_new_int(devices[ix].address));
+        int count = sfbus_read_errors(devices[ix].rs485_descriptor, devices[ix].address, deltas, 0);
+        json_object_object_add(result, "samples", json_object_new_int(count < 0 ? 0 : count));
+        if (count <= 0)
+        {
+            json_object_object_add(result, "success", json_object_new_boolean(false));
+            json_object_array_add(results, result);
+            continue;
+        }
+        double sum = 0;
+        for (int i = 0; i < count; i++)
+        {
+            sum += deltas[i];
+        }
+        double delta = sum / count;
+        json_object_object_add(result, "delta", json_object_new_double(delta));
+        int manual = 0;
+        for (int i = 0; i < SFBUS_FLAPS; i++)
+        {
+            manual |= devices[ix].flapcal[i] != 0;
+        }
+        if (manual && !overwrite)
+        { // keep table set by dr_setflapcal or an earlier calibration
+            json_object_object_add(result, "skipped", json_object_new_boolean(true));
+            json_object_object_add(result, "success", json_object_new_boolean(false));
+            json_object_array_add(results, result);
+            continue;
+        }
+        // the error adds up with the steps from home to the flap, which are
+        // counted from the home offset and wrap at one revolution
+        int offset = devices[ix].calibration < SFDEVICE_OFFSET_MIN ? SFDEVICE_OFFSET_DEF : devices[ix].calibration;
+        int8_t table[SFBUS_FLAPS];
+        for (int i = 0; i < SFBUS_FLAPS; i++)
+        {
+            int steps = (i * SFDEVICE_STEPS_PER_FLAP + offset) % SFDEVICE_STEPS_PER_REV;
+            double correction = delta * steps / SFDEVICE_STEPS_PER_REV;
+            correction = correction < -128 ? -128 : (correction > 127 ? 127 : correction);
+            table[i] = (int8_t)(correction < 0 ? correction - 0.5 : correction + 0.5);
+        }
+        int success =
+            sfbus_write_flapcal(devices[ix].rs485_descriptor, devices[ix].address, 0, SFBUS_FLAPS, table) == 0;
+        calibrated += success;
+        if (success)
+        {
+            memcpy(devices[ix].flapcal, table, SFBUS_FLAPS);
+        }
+        json_object_object_add(result, "success", json_object_new_boolean(success));
+        json_object_array_add(results, result);
+    }
+    json_object_object_add(root, "devices", results);
+    json_object_object_add(root, "calibrated", json_object_new_int(calibrated));
+    return calibrated;
+}
+
+// move mode of request key: true, false or "auto". def if key is missing
+int devicemgr_parseMove(json_object *jval, int def)
+{
+    if (jval == NULL)
+    {
+        return def;
+    }
+    if (json_object_is_type(jval, json_type_string))
+    {
+        const char *mode = json_object_get_string(jval);
+        return strcmp(mode, "auto") == 0 ? SFDEVICE_MOVE_AUTO
+                                         : (strcmp(mode, "full") == 0 ? SFDEVICE_MOVE_FULL : SFDEVICE_MOVE_DIRECT);
+    }
+    return json_object_get_boolean(jval) ? SFDEVICE_MOVE_FULL : SFDEVICE_MOVE_DIRECT;
+}
+
+// read or change power budget. Keys of req that are present are applied,
+// the resulting configuration is added to res
+void devicemgr_power(json_object *req, json_object *res)
+{
+    json_object *jval;
+    if (req != NULL)
+    {
+        if (json_object_object_get_ex(req, "budget_ma", &jval))
+        {
+            power.budget_ma = json_object_get_int(jval);
+        }
+        if (json_object_object_get_ex(req, "inrush_ma", &jval))
+        {
+            power.inrush_ma = json_object_get_int(jval);
+        }
+        if (json_object_object_get_ex(req, "inrush_ms", &jval))
+        {
+            power.inrush_ms = json_object_get_int(jval);
+        }
+        if (json_object_object_get_ex(req, "run_ma", &jval))
+        {
+            power.run_ma = json_object_get_int(jval);
+        }
+        if (json_object_object_get_ex(req, "hold_ma", &jval))
+        {
+            power.hold_ma = json_object_get_int(jval);
+        }
+        if (json_object_object_get_ex(req, "power_off_idle", &jval))
+        {
+            power.power_off_idle = json_object_get_boolean(jval);
+        }
+    }
+    if (res != NULL)
+    {
+        json_object_object_add(res, "budget_ma", json_object_new_int(power.budget_ma));
+        json_object_object_add(res, "inrush_ma", json_object_new_int(power.inrush_ma));
+        json_object_object_add(res, "inrush_ms", json_object_new_int(power.inrush_ms));
+        json_object_object_add(res, "run_ma", json_object_new_int(power.run_ma));
+        json_object_object_add(res, "hold_ma", json_object_new_int(power.hold_ma));
+        json_object_object_add(res, "power_off_idle", json_object_new_boolean(power.power_off_idle));
+    }
+}
+
+// zone by name, -1 if not defined
+static int zoneFind(const char *name)
+{
+    for (int i = 0; i < zoneCount; i++)
+    {
+        if (strcmp(zones[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int zoneMember(int zone, int id)
+{
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        if (zones[zone].ids[i] == id)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// amount of zones containing device, skipping zone skip
+static int zoneMemberships(int id, int skip)
+{
+    int count = 0;
+    for (int i = 0; i < zoneCount; i++)
+    {
+        if (i != skip && zoneMember(i, id))
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// lowest group address not used by a zone, 0 if all are used
+static u_int16_t zoneFreeGroup()
+{
+    for (u_int32_t group = SFBUS_ADDR_GROUP_MIN; group <= SFBUS_ADDR_GROUP_MAX; group++)
+    {
+        int used = 0;
+        for (int i = 0; i < zoneCount && !used; i++)
+        {
+            used = zones[i].group == group;
+        }
+        if (!used)
+        {
+            return group;
+        }
+    }
+    return 0;
+}
+
+// add zone without writing group tables, e.g. when loading the config. returns index, -1 if out of memory
+static int zoneAdd(const char *name, u_int16_t group, int *ids, int count)
+{
+    struct SFZONE *grown = realloc(zones, sizeof(struct SFZONE) * (zoneCount + 1));
+    if (grown == NULL)
+    {
+        return -1;
+    }
+    zones = grown;
+    struct SFZONE *zone = &zones[zoneCount];
+    memset(zone, 0, sizeof(struct SFZONE));
+    strncpy(zone->name, name, SFDEVICE_ZONE_NAME - 1);
+    zone->group = group;
+    zone->ids = ids;
+    zone->count = count;
+    return zoneCount++;
+}
+
+// write groups of all zones containing device to its group table. returns -1 if the device did not confirm
+static int zoneSync(int id)
+{
+    u_int16_t groups[SFBUS_GROUPS];
+    int count = 0;
+    for (int i = 0; i < zoneCount && count < SFBUS_GROUPS; i++)
+    {
+        if (zoneMember(i, id))
+        {
+            groups[count++] = zones[i].group;
+        }
+    }
+    return sfbus_write_groups(devices[id].rs485_descriptor, devices[id].address, groups, count);
+}
+
+// write group tables of devices, addresses of devices that did not confirm are added to failed
+static void zoneSyncAll(int *ids, int count, json_object *failed)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (devices[ids[i]].address > 0 && zoneSync(ids[i]) < 0)
+        {
+            json_object_array_add(failed, json_object_new_int(devices[ids[i]].address));
+        }
+    }
+}
+
+// drop device from all zones, e.g. if it is removed
+static void zoneDrop(int id)
+{
+    for (int i = 0; i < zoneCount; i++)
+    {
+        for (int j = 0; j < zones[i].count; j++)
+        {
+            if (zones[i].ids[j] == id)
+            {
+                zones[i].ids[j] = zones[i].ids[--zones[i].count];
+                break;
+            }
+        }
+    }
+}
+
+// collect registered devices selected by req: "ids" (array), "row" (y) or
+// "rect" ({x, y, w, h}). returns amount of devices, -1 if nothing is selected
+static int zoneSelect(json_object *req, int **ids)
+{
+    json_object *jsel;
+    int count = 0;
+    *ids = malloc(sizeof(int) * (deviceCapacity > 0 ? deviceCapacity : 1));
+    if (*ids == NULL)
+    {
+        return -1;
+    }
+    if (json_object_object_get_ex(req, "ids", &jsel))
+    {
+        int len = json_object_array_length(jsel);
+        for (int i = 0; i < len; i++)
+        {
+            int id = json_object_get_int(json_object_array_get_idx(jsel, i));
+            int known = 0;
+            for (int j = 0; j < count && !known; j++)
+            {
+                known = (*ids)[j] == id;
+            }
+            if (id >= 0 && id < deviceCapacity && devices[id].address > 0 && !known)
+            {
+                (*ids)[count++] = id;
+            }
+        }
+        return count;
+    }
+    int x0 = 0, y0, x1 = SFDEVICE_GRID_MAX, y1;
+    if (json_object_object_get_ex(req, "row", &jsel))
+    {
+        y0 = json_object_get_int(jsel);
+        y1 = y0 + 1;
+    }
+    else if (json_object_object_get_ex(req, "rect", &jsel))
+    {
+        x0 = json_object_get_int(json_object_object_get(jsel, "x"));
+        y0 = json_object_get_int(json_object_object_get(jsel, "y"));
+        x1 = x0 + json_object_get_int(json_object_object_get(jsel, "w"));
+        y1 = y0 + json_object_get_int(json_object_object_get(jsel, "h"));
+    }
+    else
+    {
+        free(*ids);
+        *ids = NULL;
+        return -1;
+    }
+    for (int ix = 0; ix < deviceCapacity; ix++)
+    {
+        if (devices[ix].address > 0 && devices[ix].pos_x >= x0 && devices[ix].pos_x < x1 &&
+            devices[ix].pos_y >= y0 && devices[ix].pos_y < y1)
+        {
+            (*ids)[count++] = ix;
+        }
+    }
+    return count;
+}
+
+// buses of zone members, so the zone frame is sent once per bus. returns amount of buses
+static int zoneBuses(int zone, int *fds)
+{
+    int count = 0;
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        int fd = devices[zones[zone].ids[i]].rs485_descriptor;
+        int known = 0;
+        for (int j = 0; j < count && !known; j++)
+        {
+            known = fds[j] == fd;
+        }
+        if (!known && count < SFBUS_AIR_BUSES)
+        {
+            fds[count++] = fd;
+        }
+    }
+    return count;
+}
+
+// forget pending work of a reset device. A verified position survives the reset
+// (warm boot), so current_flap is kept, the next status read corrects it from the
+// position readback. Timed starts and checks of earlier moves are void, the
+// sequence history of the module is cleared and accepts the next number as is
+static void resetState(int id)
+{
+    devices[id].start_timed = 0;
+    devices[id].verify_pending = 0;
+    devices[id].powerState = UNKNOWN;
+}
+
+// check if all members of zone can start at once within the power budget of their bus
+static int zoneFits(int zone, int *fds, int buses)
+{
+    if (power.budget_ma == 0)
+    {
+        return 1;
+    }
+    for (int b = 0; b < buses; b++)
+    {
+        int load = 0;
+        for (int ix = 0; ix < deviceCapacity; ix++)
+        {
+            if (devices[ix].address == 0 || devices[ix].rs485_descriptor != fds[b])
+            {
+                continue;
+            }
+            if (zoneMember(zone, ix))
+            {
+                load += power.inrush_ma + power.run_ma;
+            }
+            else if (devices[ix].deviceState == ONLINE && devices[ix].powerState != DISABLED)
+            {
+                load += power.hold_ma;
+            }
+        }
+        if (load > power.budget_ma)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Define zone of devices selected by req (see zoneSelect) and write the group
+ * tables of all members, so the zone is reached with a single frame. A zone
+ * that exists already is replaced and keeps its group address. Addresses of
+ * devices that did not confirm their table are added to res as "failed".
+ * returns group address, -1 if no devices are selected, -2 if no group address
+ * is free and -3 if a device is member of SFBUS_GROUPS zones already
+ */
+int devicemgr_zoneDefine(const char *name, json_object *req, json_object *res)
+{
+    int *ids;
+    int count = zoneSelect(req, &ids);
+    if (count <= 0)
+    {
+        free(ids);
+        return -1;
+    }
+    int zone = zoneFind(name);
+    for (int i = 0; i < count; i++)
+    {
+        if (zoneMemberships(ids[i], zone) >= SFBUS_GROUPS)
+        {
+            free(ids);
+            return -3;
+        }
+    }
+    int *old_ids = NULL;
+    int old_count = 0;
+    if (zone >= 0)
+    {
+        old_ids = zones[zone].ids;
+        old_count = zones[zone].count;
+        zones[zone].ids = ids;
+        zones[zone].count = count;
+    }
+    else
+    {
+        u_int16_t group = zoneFreeGroup();
+        if (group == 0 || (zone = zoneAdd(name, group, ids, count)) < 0)
+        {
+            free(ids);
+            return -2;
+        }
+    }
+    json_object *failed = json_object_new_array();
+    // members left the zone
+    for (int i = 0; i < old_count; i++)
+    {
+        if (!zoneMember(zone, old_ids[i]))
+        {
+            zoneSyncAll(&old_ids[i], 1, failed);
+        }
+    }
+    free(old_ids);
+    zoneSyncAll(ids, count, failed);
+    json_object_object_add(res, "failed", failed);
+    return zones[zone].group;
+}
+
+// remove zone and clear its group from the tables of its members. returns -1 if zone is not defined
+int devicemgr_zoneRemove(const char *name, json_object *res)
+{
+    int zone = zoneFind(name);
+    if (zone < 0)
+    {
+        return -1;
+    }
+    int *ids = zones[zone].ids;
+    int count = zones[zone].count;
+    zones[zone] = zones[--zoneCount];
+    json_object *failed = json_object_new_array();
+    zoneSyncAll(ids, count, failed);
+    json_object_object_add(res, "failed", failed);
+    free(ids);
+    return 0;
+}
+
+// write group tables of zone members again, e.g. after a module was replaced.
+// returns -1 if zone is not defined
+int devicemgr_zoneSync(const char *name, json_object *res)
+{
+    int zone = zoneFind(name);
+    if (zone < 0)
+    {
+        return -1;
+    }
+    json_object *failed = json_object_new_array();
+    zoneSyncAll(zones[zone].ids, zones[zone].count, failed);
+    json_object_object_add(res, "failed", failed);
+    return 0;
+}
+
+// add all zones to res
+void devicemgr_zones(json_object *res)
+{
+    json_object *jzones = json_object_new_array();
+    for (int i = 0; i < zoneCount; i++)
+    {
+        json_object *jzone = json_object_new_object();
+        json_object *jids = json_object_new_array();
+        for (int j = 0; j < zones[i].count; j++)
+        {
+            json_object_array_add(jids, json_object_new_int(zones[i].ids[j]));
+        }
+        json_object_object_add(jzone, "name", json_object_new_string(zones[i].name));
+        json_object_object_add(jzone, "group", json_object_new_int(zones[i].group));
+        json_object_object_add(jzone, "ids", jids);
+        json_object_array_add(jzones, jzone);
+    }
+    json_object_object_add(res, "zones", jzones);
+}
+
+// load zones of config. Group tables are stored on the devices and not written again
+static void zoneLoad(json_object *jzones)
+{
+    int len = json_object_array_length(jzones);
+    for (int i = 0; i < len; i++)
+    {
+        json_object *jzone = json_object_array_get_idx(jzones, i);
+        json_object *jname = json_object_object_get(jzone, "name");
+        json_object *jgroup = json_object_object_get(jzone, "group");
+        json_object *jids = json_object_object_get(jzone, "ids");
+        if (jname == NULL || jgroup == NULL || jids == NULL)
+        {
+            fprintf(stderr, "Error: Key 'zones.%s' not found\n",
+                    jname == NULL ? "name" : (jgroup == NULL ? "group" : "ids"));
+            continue;
+        }
+        u_int16_t group = json_object_get_int(jgroup);
+        int used = zoneFind(json_object_get_string(jname)) >= 0;
+        for (int j = 0; j < zoneCount && !used; j++)
+        {
+            used = zones[j].group == group;
+        }
+        if (group < SFBUS_ADDR_GROUP_MIN || group > SFBUS_ADDR_GROUP_MAX || used)
+        {
+            fprintf(stderr, "Error: zone '%s' has invalid group\n", json_object_get_string(jname));
+            continue;
+        }
+        int *ids;
+        int count = zoneSelect(jzone, &ids);
+        if (count < 0 || zoneAdd(json_object_get_string(jname), group, ids, count) < 0)
+        {
+            free(ids);
+        }
+    }
+}
+
+/*
+ * Display flap on all members of zone with one frame per bus. Auto moves are
+ * full rotations if any member needs one, as all members receive the same frame.
+ * Powered down members are switched on with one frame first. If the inrush of
+ * all members exceeds the power budget of a bus, the members are sent one frame
+ * each with scheduled starts instead (see printCells), grouped is set to 0 then.
+ * returns travel time in ms, -1 if zone is not defined and -2 if flap is invalid
+ */
+int devicemgr_zoneDisplay(const char *name, int flap, int fullRotation, int *grouped)
+{
+    int zone = zoneFind(name);
+    if (zone < 0)
+    {
+        return -1;
+    }
+    if (flap < 0 || flap >= SFBUS_FLAPS)
+    {
+        return -2;
+    }
+    int full = fullRotation == SFDEVICE_MOVE_FULL;
+    for (int i = 0; i < zones[zone].count && !full; i++)
+    {
+        full = moveFull(zones[zone].ids[i], fullRotation);
+    }
+    int fds[SFBUS_AIR_BUSES];
+    int buses = zoneBuses(zone, fds);
+    *grouped = zoneFits(zone, fds, buses);
+    if (!*grouped)
+    { // starts must be spread, schedule members like a print
+        int *ids = malloc(sizeof(int) * (zones[zone].count + 1));
+        u_int8_t *flaps = malloc(zones[zone].count + 1);
+        int count = 0;
+        for (int i = 0; i < zones[zone].count; i++)
+        {
+            if (moveRequired(zones[zone].ids[i], flap, fullRotation))
+            {
+                ids[count] = zones[zone].ids[i];
+                flaps[count++] = flap;
+            }
+        }
+        int eta = printCells(ids, flaps, NULL, count, fullRotation, 0);
+        free(ids);
+        free(flaps);
+        return eta;
+    }
+    int powered_off = 0;
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        powered_off |= devices[zones[zone].ids[i]].powerState != ENABLED;
+    }
+    for (int i = 0; i < buses && powered_off; i++)
+    {
+        sfbus_motor_power(fds[i], zones[zone].group, 1);
+        tcdrain(fds[i]);
+    }
+    if (powered_off)
+    {
+        usleep(power.inrush_ms * 1000);
+        for (int i = 0; i < zones[zone].count; i++)
+        {
+            devices[zones[zone].ids[i]].powerState = ENABLED;
+        }
+    }
+    for (int i = 0; i < buses; i++)
+    {
+        if (full)
+        {
+            sfbus_display_full(fds[i], zones[zone].group, flap);
+        }
+        else
+        {
+            sfbus_display(fds[i], zones[zone].group, flap);
+        }
+    }
+    int ticks_max = 0;
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        int id = zones[zone].ids[i];
+        trackMove(id, flap, full);
+        int ticks = moveTicks(id, flap, full);
+        devices[id].busy_until = sfbus_ticks_now() + ticks;
+        devices[id].current_flap = flap;
+        verifyArm(id, flap, full);
+        ticks_max = ticks > ticks_max ? ticks : ticks_max;
+    }
+    verifier_kick();
+    return (int)((int64_t)ticks_max * SFBUS_TICK_US / 1000);
+}
+
+// power motors of all zone members on or off with one frame per bus. returns -1 if zone is not defined
+int devicemgr_zonePower(const char *name, int state)
+{
+    int zone = zoneFind(name);
+    if (zone < 0)
+    {
+        return -1;
+    }
+    int fds[SFBUS_AIR_BUSES];
+    int buses = zoneBuses(zone, fds);
+    for (int i = 0; i < buses; i++)
+    {
+        sfbus_motor_power(fds[i], zones[zone].group, state);
+    }
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        devices[zones[zone].ids[i]].powerState = state ? ENABLED : DISABLED;
+    }
+    return 0;
+}
+
+// reset all zone members with one frame per bus. returns -1 if zone is not defined
+int devicemgr_zoneReset(const char *name)
+{
+    int zone = zoneFind(name);
+    if (zone < 0)
+    {
+        return -1;
+    }
+    int fds[SFBUS_AIR_BUSES];
+    int buses = zoneBuses(zone, fds);
+    for (int i = 0; i < buses; i++)
+    {
+        sfbus_reset_device(fds[i], zones[zone].group);
+    }
+    for (int i = 0; i < zones[zone].count; i++)
+    {
+        resetState(zones[zone].ids[i]);
+    }
+    devicemgr_timeSyncDue();
+    return 0;
+}
+
+/*
+ * Register device at position. An id that is registered already is replaced.
+ * returns id, -1 if position is out of range, -2 if the address is invalid
+ * or used by another device, -3 if id is above SFDEVICE_ID_MAX or out of memory
+ */
+int devicemgr_register(int rs485_descriptor, u_int16_t address, int x, int y, int nid)
+{
+    if (x < 0 || y < 0 || x >= SFDEVICE_GRID_MAX || y >= SFDEVICE_GRID_MAX)
+    {
+        return -1;
+    }
+    int owner = devicemgr_findAddress(address);
+    if (address == 0 || address >= SFBUS_ADDR_GROUP_MIN || (owner >= 0 && owner != nid))
+    {
+        return -2;
+    }
+    if (nid < 0)
+    {
+        nextFreeSlot++;
+        nid = nextFreeSlot;
+    }
+    if (storeReserve(nid) < 0)
+    {
+        return -3;
+    }
+    if (devices[nid].pos_x >= 0)
+    { // id registered before at other position
+        gridChunk(devices[nid].pos_x, devices[nid].pos_y, 1)->ids[gridIndex(devices[nid].pos_x, devices[nid].pos_y)] =
+            -1;
+    }
+    if (devices[nid].address != address)
+    { // history belongs to the module, not to the id
+        telemetry_clear(nid);
+    }
+    if (devices[nid].address != 0)
+    { // id registered before with other address
+        addrDelete(devices[nid].address);
+    }
+    addrInsert(address, nid);
+
+    devices[nid].pos_x = x;
+    devices[nid].pos_y = y;
+    devices[nid].address = address;
+    devices[nid].calibration = 0;
+    devices[nid].rs485_descriptor = rs485_descriptor;
+    devices[nid].reg_voltage = 0;
+    devices[nid].reg_voltage_min = 0;
+    devices[nid].reg_voltage_max = 0;
+    devices[nid].reg_voltage_avg = 0;
+    devices[nid].reg_sags = 0;
+    devices[nid].status_ext = 1;
+    devices[nid].ext_fails = 0;
+    devices[nid].ext_retry = 0;
+    devices[nid].poll_backoff = 0;
+    devices[nid].poll_skip = 0;
+    devices[nid].reg_counter = 0;
+    devices[nid].reg_status = 0;
+    devices[nid].current_flap = 0;
+    devices[nid].moves_since_home = 0;
+    devices[nid].home_expected = 0;
+    devices[nid].drift = 0;
+    devices[nid].drift_events = 0;
+    memset(devices[nid].flapcal, 0, SFBUS_FLAPS);
+    devices[nid].deviceState = NEW;
+    devices[nid].powerState = DISABLED;
+    // try to reach device
+    devicemgr_readStatus(nid);
+    devicemgr_readCalib(nid);
+    if (zoneMemberships(nid, -1) > 0)
+    { // module may be new, restore its groups
+        zoneSync(nid);
+    }
+    struct SFGRID_CHUNK *chunk = gridChunk(x, y, 1);
+    int old_id = chunk->ids[gridIndex(x, y)];
+    if (old_id >= 0 && old_id != nid)
+    { // rest old ones
+        devices[old_id].pos_x = -1;
+        devices[old_id].pos_y = -1;
+    }
+    chunk->ids[gridIndex(x, y)] = nid;
+    gridWidth = x >= gridWidth ? x + 1 : gridWidth;
+    gridHeight = y >= gridHeight ? y + 1 : gridHeight;
+    return nid;
+}
+
+// change address of registered device after it was written to the device.
+// returns -1 if new address is used by another device
+int devicemgr_changeAddress(u_int16_t address, u_int16_t new_address)
+{
+    int id = devicemgr_findAddress(address);
+    if (id < 0 || address == new_address)
+    {
+        return 0;
+    }
+    if (new_address == 0 || new_address >= SFBUS_ADDR_GROUP_MIN || devicemgr_findAddress(new_address) >= 0)
+    {
+        return -1;
+    }
+    addrDelete(address);
+    addrInsert(new_address, id);
+    devices[id].address = new_address;
+    return 0;
+}
+
+// update state of device reset by a raw command, see resetState
+void devicemgr_rawReset(u_int16_t address)
+{
+    int id = devicemgr_findAddress(address);
+    if (id >= 0)
+    {
+        resetState(id);
+    }
+    devicemgr_timeSyncDue();
+}
+
+// track flap and power state of registered device changed by raw commands.
+// flap < 0 or power < 0 leave the value unchanged, tick is the start (bus time).
+// returns expected end of the move (bus time), now if nothing is tracked
+u_int32_t devicemgr_rawState(u_int16_t address, int flap, int fullRotation, u_int32_t tick, int power)
+{
+    int id = devicemgr_findAddress(address);
+    if (id < 0)
+    {
+        return sfbus_ticks_now();
+    }
+    if (flap >= 0 && flap < SFBUS_FLAPS)
+    {
+        trackMove(id, flap, fullRotation);
+        int32_t wait = (int32_t)(tick - sfbus_ticks_now());
+        devices[id].busy_until = sfbus_ticks_now() + (wait > 0 ? wait : 0) + moveTicks(id, flap, fullRotation);
+        devices[id].current_flap = flap;
+    }
+    if (power >= 0)
+    {
+        devices[id].powerState = power ? ENABLED : DISABLED;
+    }
+    return devices[id].busy_until;
+}
+
+/*
+ * Send bus time to all devices, if a device reported an unsynced tick counter
+ * (reset), a device was found or came back online, or the last sync is older
+ * than SFDEVICE_SYNC_PERIOD_MS. force sends it in any case.
+ */
+void devicemgr_timeSync(int force)
+{
+    u_int32_t now = sfbus_ticks_now();
+    if (!force && !timeSyncDue &&
+        (int32_t)(now - timeSyncTick) < (int32_t)(SFDEVICE_SYNC_PERIOD_MS * 1000LL / SFBUS_TICK_US))
+    {
+        return;
+    }
+    sfbus_time_sync(deviceFd);
+    timeSyncTick = now;
+    timeSyncDue = 0;
+}
+
+// request sync of bus time before next timed start, e.g. after devices were reset
+void devicemgr_timeSyncDue()
+{
+    timeSyncDue = 1;
+}
+
+// refreshes status of all devices
+int devicemgr_refresh(int *skipped)
+{
+    int devices_online = 0;
+    *skipped = 0;
+    for (int ix = 0; ix < deviceCapacity; ix++)
+    {
+        if (devices[ix].address > 0)
+        {
+            if (!sfbus_airtime_admit(devices[ix].rs485_descriptor, sfbus_transaction_us(2, 16), SFBUS_PRIO_POLL))
+            {
+                (*skipped)++;
+                continue;
+            }
+            devicemgr_readStatus(ix);
+            if (devices[ix].deviceState == ONLINE)
+            {
+                devices_online++;
+            }
+        }
+    }
+    return devices_online;
+}
+
+// check last move of device. returns 0 if it arrived, 1 if still moving and -1 if it failed.
+// position readback is used if supported by the firmware, else the rotation counter of full rotations
+static int verifyCheck(int id)
+{
+    struct SFDEVICE *device = &devices[id];
+    if (devicemgr_readStatus(id) < 0 || ((device->reg_status >> 5) & 0x01))
+    {
+        return -1;
+    }
+    if ((device->reg_status >> 6) & 0x01)
+    {
+        return 1;
+    }
+    if (device->reg_flap >= 0 && device->reg_flap < SFBUS_FLAPS)
+    {
+        return device->reg_flap == device->verify_flap ? 0 : -1;
+    }
+    if (device->verify_full && (int32_t)(device->reg_counter - device->verify_counter) < 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+// send failed move of device again, directly without staging
+static void verifyResend(int id)
+{
+    struct SFDEVICE *device = &devices[id];
+    if (device->reg_flap >= 0 && device->reg_flap < SFBUS_FLAPS)
+    { // travel time from real position
+        device->current_flap = device->reg_flap;
+    }
+    trackMove(id, device->verify_flap, device->verify_full);
+    if (device->verify_full)
+    {
+        sfbus_display_full(device->rs485_descriptor, device->address, device->verify_flap);
+    }
+    else
+    {
+        sfbus_display(device->rs485_descriptor, device->address, device->verify_flap);
+    }
+    u_int32_t now = sfbus_ticks_now();
+    device->busy_until = now + moveTicks(id, device->verify_flap, device->verify_full);
+    device->current_flap = device->verify_flap;
+    device->verify_resend = 0;
+    device->verify_counter = device->reg_counter + (device->verify_full ? 1 : 0);
+    device->verify_at = device->busy_until + SFDEVICE_VERIFY_MARGIN_MS * 1000 / SFBUS_TICK_US;
+    device->verify_deadline = device->verify_at + SFDEVICE_ROTATION_TIMEOUT * 1000 / SFBUS_TICK_US;
+}
+
+// count result of finished check. Failed moves are resent after a backoff
+// doubled with every resend. returns 1 if the device stays in the queue
+static int verifyResult(int id, int result)
+{
+    struct SFDEVICE *device = &devices[id];
+    verifyMetrics.checked++;
+    if (result == 0)
+    {
+        verifyMetrics.recovered += device->verify_retries > 0 ? 1 : 0;
+        device->verify_pending = 0;
+        return 0;
+    }
+    verifyMetrics.failed++;
+    if (device->verify_retries >= SFDEVICE_VERIFY_RETRIES)
+    {
+        fprintf(stderr, "[WARN][devicemgr] device %i: flap %i not reached after %i resends\n", device->address,
+                device->verify_flap, device->verify_retries);
+        verifyMetrics.lost++;
+        device->drift = 1; // next auto move passes home
+        device->verify_pending = 0;
+        return 0;
+    }
+    device->verify_resend = 1;
+    int backoff_ms = SFDEVICE_VERIFY_BACKOFF_MS << device->verify_retries;
+    device->verify_at = sfbus_ticks_now() + backoff_ms * 1000 / SFBUS_TICK_US;
+    device->verify_retries++;
+    return 1;
+}
+
+/*
+ * Check moves that should have ended by polling the status of the moved
+ * devices only, and resend failed moves when their backoff is over. At most
+ * SFDEVICE_VERIFY_BATCH devices are polled per call, so the bus lock is not
+ * held too long.
+ * returns time in ms until next check is due, 0 if checks are left or -1 if
+ * nothing is pending.
+ */
+int devicemgr_verify()
+{
+    int32_t next = -1;
+    int polled = 0;
+    int kept = 0;
+    for (int i = 0; i < verifyCount; i++)
+    {
+        int id = verifyQueue[i];
+        struct SFDEVICE *device = &devices[id];
+        if (device->address == 0 || !device->verify_pending)
+        { // removed
+            device->verify_pending = 0;
+            continue;
+        }
+        int32_t wait = (int32_t)(device->verify_at - sfbus_ticks_now());
+        if (wait <= 0 && polled < SFDEVICE_VERIFY_BATCH && !device->verify_resend &&
+            !sfbus_airtime_admit(device->rs485_descriptor, sfbus_transaction_us(2, 16), SFBUS_PRIO_CHECK))
+        { // bus budget used up by display traffic, check later
+            device->verify_at = sfbus_ticks_now() + SFDEVICE_VERIFY_BUSY_MS * 1000 / SFBUS_TICK_US;
+            wait = (int32_t)(device->verify_at - sfbus_ticks_now());
+        }
+        else if (wait <= 0 && polled < SFDEVICE_VERIFY_BATCH)
+        {
+            polled++;
+            int result = device->verify_resend ? 2 : verifyCheck(id);
+            u_int32_t now = sfbus_ticks_now();
+            if (result == 2)
+            {
+                verifyResend(id);
+                verifyMetrics.resent++;
+            }
+            else if (result == 1 && (int32_t)(device->verify_deadline - now) > 0)
+            { // still moving
+                device->verify_at = now + SFDEVICE_VERIFY_BUSY_MS * 1000 / SFBUS_TICK_US;
+            }
+            else if (verifyResult(id, result) == 0)
+            {
+                continue;
+            }
+            wait = (int32_t)(device->verify_at - sfbus_ticks_now());
+        }
+        wait = wait > 0 ? wait : 0;
+        next = next < 0 || wait < next ? wait : next;
+        verifyQueue[kept++] = id;
+    }
+    verifyCount = kept;
+    verifyMetrics.pending = kept;
+    devicemgr_timeSync(0); // a checked device may have been reset
+    return next < 0 ? -1 : (next * SFBUS_TICK_US) / 1000;
+}
+
+// add counters of move checks to res
+void devicemgr_verifyMetrics(json_object *res)
+{
+    json_object *verify = json_object_new_object();
+    json_object_object_add(verify, "pending", json_object_new_int(verifyMetrics.pending));
+    json_object_object_add(verify, "checked", json_object_new_int64(verifyMetrics.checked));
+    json_object_object_add(verify, "failed", json_object_new_int64(verifyMetrics.failed));
+    json_object_object_add(verify, "resent", json_object_new_int64(verifyMetrics.resent));
+    json_object_object_add(verify, "recovered", json_object_new_int64(verifyMetrics.recovered));
+    json_object_object_add(verify, "lost", json_object_new_int64(verifyMetrics.lost));
+    json_object_object_add(res, "verify", verify);
+}
+
+// poll status of devices within the airtime budget of status polling. Devices
+// that do not fit are polled first next time. returns number of polled devices
+int devicemgr_poll()
+{
+    int polled = 0;
+    int full[SFBUS_AIR_BUSES]; // buses without polling budget left
+    int fulls = 0;
+    int next = -1;
+    devicemgr_timeSync(0); // resets found by last poll, periodic sync
+    for (int n = 0; n < deviceCapacity; n++)
+    {
+        int ix = (pollCursor + n) % deviceCapacity;
+        if (devices[ix].address == 0)
+        {
+            continue;
+        }
+        int skip = 0;
+        for (int b = 0; b < fulls; b++)
+        {
+            skip |= full[b] == devices[ix].rs485_descriptor;
+        }
+        if (!skip && !sfbus_airtime_admit(devices[ix].rs485_descriptor, sfbus_transaction_us(2, 16), SFBUS_PRIO_POLL))
+        { // other buses are polled, this one continues here next time
+            full[fulls < SFBUS_AIR_BUSES ? fulls++ : fulls - 1] = devices[ix].rs485_descriptor;
+            next = next < 0 ? ix : next;
+            skip = 1;
+        }
+        if (skip)
+        {
+            continue;
+        }
+        if (devices[ix].poll_skip > 0)
+        { // offline, every timeout blocks the bus
+            devices[ix].poll_skip--;
+            continue;
+        }
+        if (readStatus(ix, 1) == -1)
+        {
+            u_int8_t backoff = devices[ix].poll_backoff * 2;
+            backoff = backoff == 0 ? 1 : backoff;
+            devices[ix].poll_backoff = backoff > SFDEVICE_POLL_BACKOFF_MAX ? SFDEVICE_POLL_BACKOFF_MAX : backoff;
+            devices[ix].poll_skip = devices[ix].poll_backoff;
+        }
+        else
+        {
+            devices[ix].poll_backoff = 0;
+        }
+        polled++;
+    }
+    pollCursor = next < 0 ? pollCursor : next;
+    return polled;
+}
+
+// read or change airtime limits of status polling and move checks (percent
+// of bus time). Keys of req that are present are applied, the resulting
+// configuration and the usage of the bus are added to res
+void devicemgr_airtime(json_object *req, json_object *res)
+{
+    json_object *jval;
+    if (req != NULL && json_object_object_get_ex(req, "poll_limit", &jval))
+    {
+        sfbus_airtime_limit(SFBUS_PRIO_POLL, json_object_get_int(jval));
+    }
+    if (req != NULL && json_object_object_get_ex(req, "check_limit", &jval))
+    {
+        sfbus_airtime_limit(SFBUS_PRIO_CHECK, json_object_get_int(jval));
+    }
+    struct SFBUS_AIRTIME *air = sfbus_airtime(deviceFd);
+    const char *classes[SFBUS_PRIO_COUNT] = {"display", "check", "poll"}; // display is always admitted
+    json_object_object_add(res, "window_ms", json_object_new_int(SFBUS_AIR_WINDOW_MS));
+    json_object_object_add(res, "used_ms", json_object_new_double(sfbus_airtime_used_us(deviceFd) / 1000.0));
+    json_object_object_add(res, "utilization",
+                           json_object_new_double(sfbus_airtime_used_us(deviceFd) / (SFBUS_AIR_WINDOW_MS * 10.0)));
+    for (int prio = SFBUS_PRIO_CHECK; prio < SFBUS_PRIO_COUNT; prio++)
+    {
+        json_object *jclass = json_object_new_object();
+        json_object_object_add(jclass, "limit", json_object_new_int(sfbus_airtime_limit(prio, -1)));
+        json_object_object_add(jclass, "admitted", json_object_new_int64(air->admitted[prio]));
+        json_object_object_add(jclass, "deferred", json_object_new_int64(air->deferred[prio]));
+        json_object_object_add(res, classes[prio], jclass);
+    }
+}
+
+// remove devices from system. returns -1 if id is invalid
+int devicemgr_remove(int id)
+{
+    if (id < 0 || id >= deviceCapacity || devices[id].address == 0)
+    {
+        return -1;
+    }
+    if (devices[id].pos_x >= 0)
+    {
+        gridChunk(devices[id].pos_x, devices[id].pos_y, 1)->ids[gridIndex(devices[id].pos_x, devices[id].pos_y)] = -1;
+    }
+    addrDelete(devices[id].address);
+    telemetry_clear(id);
+    zoneDrop(id);
+    devices[id].deviceState = REMOVED;
+    devices[id].address = 0;
+    devices[id].rs485_descriptor = NULL;
+    devices[id].pos_x = -1;
+    devices[id].pos_y = -1;
+    return 0;
+}
+
+int devicemgr_save(char *file)
+{
+    json_object *root = json_object_new_object();
+    json_object_object_add(root, "nextFreeSlot", json_object_new_int(nextFreeSlot));
+    json_object *device_array = json_object_new_array();
+    for (int ix = 0; ix < deviceCapacity; ix++)
+    {
+        if (devices[ix].address > 0)
+        {
+            json_object *device = json_object_new_object();
+            devicemgr_printDetails(ix, device);
+            json_object_array_add(device_array, device);
+        }
+    }
+
+    json_object_object_add(root, "devices", device_array);
+    json_object *power_obj = json_object_new_object();
+    devicemgr_power(NULL, power_obj);
+    json_object_object_add(root, "power", power_obj);
+    devicemgr_zones(root);
+
+    char *data = json_object_to_json_string_ext(root, JSON_C_TO_STRING_PRETTY);
+    printf("[INFO][console] store data to %s\n", file);
+
+    FILE *fptr;
+    fptr = fopen(file, "w");
+    fwrite(data, sizeof(char), strlen(data), fptr);
+    fclose(fptr);
+}
+
+int devicemgr_load(char *file)
+{
+    FILE *fptr;
+    const char *line_in_file = malloc(JSON_MAX_LINE_LEN); // maximum of 256 bytes per line;
+    fptr = fopen(file, "r");
+    json_tokener *tok = json_tokener_new();
+    json_object *jobj = NULL;
+    int stringlen = 0;
+    enum json_tokener_error jerr;
+
+    do
+    {
+        int read_ret = fgets(line_in_file, JSON_MAX_LINE_LEN, fptr); // read line from file
+        stringlen = strlen(line_in_file);
+        // printf("Read line with chars: %i : %s", stringlen, line_in_file); // only for testing
+        jobj = json_tokener_parse_ex(tok, line_in_file, stringlen);
+        if (read_ret == NULL)
+        {
+            break;
+        }
+    } while ((jerr = json_tokener_get_error(tok)) == json_tokener_continue);
+    if (jerr != json_tokener_success)
+    {
+        free(fptr); //free file pointer
+        fprintf(stderr, "Error: %s\n", json_tokener_error_desc(jerr));
+        // Handle errors, as appropriate for your application.
+        return -1;
+    }
+
+    // cleanup
+    free(fptr); //free file pointer
+    free(tok);  //free tokenizer
+
+    // dump loadad data to terminal ( for tetsting)
+    // char *data = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
+    // printf("%s",data);
+
+    // load data
+    json_object *next_free;
+    if (!json_object_object_get_ex(jobj, "nextFreeSlot", &next_free))
+    {
+        fprintf(stderr, "Error: %s\n", "Key 'nextFreeSlot' not found.");
+        return -1;
+    }
+    else
+    {
+        nextFreeSlot = json_object_get_int(next_free);
         free(next_free);
     }
 
     // clear config
     devicemgr_init(deviceFd);
 
+    // load power budget, optional
+    json_object *power_obj;
+    if (json_object_object_get_ex(jobj, "power", &power_obj))
+    {
+        devicemgr_power(power_obj, NULL);
+    }
+
     // load devices
     json_object *devices;
     if (!json_object_object_get_ex(jobj, "devices", &devices))
@@ -440,6 +2651,13 @@ int devicemgr_load(char *file)
 
         free(devices);
     }
+
+    // load zones, optional. members must be registered
+    json_object *zones_obj;
+    if (json_object_object_get_ex(jobj, "zones", &zones_obj))
+    {
+        zoneLoad(zones_obj);
+    }
 }
 
 int devicemgr_load_single(json_object *device_obj)
@@ -472,9 +2690,15 @@ int devicemgr_load_single(json_object *device_obj)
     }
 
     // create device
-    devicemgr_register(deviceFd,
-                       json_object_get_int(jaddr),
-                       json_object_get_int(jposx),
-                       json_object_get_int(jposy),
-                       json_object_get_int(jid));
+    int id = devicemgr_register(deviceFd,
+                                json_object_get_int(jaddr),
+                                json_object_get_int(jposx),
+                                json_object_get_int(jposy),
+                                json_object_get_int(jid));
+    if (id < 0)
+    {
+        fprintf(stderr, "Error: device %i not registered (%i)\n", json_object_get_int(jid), id);
+        return -1;
+    }
+    return 0;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
  *
  */
 
+#pragma once
 #include "sfbus.h"
 #include <ctype.h>
 #include <errno.h> // Error integer and strerror() function
@@ -22,6 +23,42 @@
 #include <termios.h> // Contains POSIX terminal control definitions
 #include <unistd.h>  // write(), read(), close()
 
+enum
+{
+    SFDEVICE_GRID_MAX = 0x10000, // positions are 0 to 65535 in x and y
+    SFDEVICE_ID_MAX = 0xFFFF,    // highest device id, bounds the device store
+    SFDEVICE_ZONE_NAME = 32,     // max. length of zone name incl. terminator
+    JSON_MAX_LINE_LEN = 256
+};
+
+// fullRotation argument of print functions
+enum SFDEVICE_MOVE
+{
+    SFDEVICE_MOVE_DIRECT = 0, // shortest move to flap
+    SFDEVICE_MOVE_FULL = 1,   // full rotation, passes home and recalibrates
+    SFDEVICE_MOVE_AUTO = 2    // direct move unless drift is suspected, see moveFull
+};
+
+// cell of frame, see devicemgr_printFrame
+struct SFDEVICE_CELL
+{
+    int x;
+    int y;
+    u_int8_t flap;
+    u_int16_t delay_ms; // arrival after start of frame
+};
+
+// counters of move checks, see devicemgr_verify
+struct SFVERIFY_METRICS
+{
+    int pending;         // devices waiting for check
+    u_int32_t checked;   // completed checks
+    u_int32_t failed;    // checks that found the wrong flap, no answer or a device still busy at deadline
+    u_int32_t resent;    // moves sent again
+    u_int32_t recovered; // moves that arrived after resending
+    u_int32_t lost;      // moves given up after all resends
+};
+
 int devicemgr_readStatus(int device_id);
 int devicemgr_readCalib(int device_id);
 void devicemgr_printDetails(int device_id, json_object *root);
@@ -29,7 +66,35 @@ void devicemgr_printDetailsAll(json_object *root);
 int devicemgr_register(int rs485_descriptor, u_int16_t address, int x, int y, int nid);
 void devicemgr_init();
 int devicemgr_print(char *text);
-int devicemgr_refresh();
+int devicemgr_refresh(int *skipped);
 int devicemgr_save(char *file);
-void devicemgr_printText(char *text, int x, int y);
-void devicemgr_printFlap(int flap, int x, int y);
\ No newline at end of file
+int devicemgr_printText(char *text, int x, int y, int fullRotation, u_int32_t arrival);
+int devicemgr_printDuration(char *text, int x, int y, int fullRotation);
+int devicemgr_printFrame(struct SFDEVICE_CELL *cells, int count, int fullRotation, u_int32_t arrival);
+int devicemgr_frameDuration(struct SFDEVICE_CELL *cells, int count, int fullRotation);
+int devicemgr_lookup(int x, int y);
+int devicemgr_remove(int id);
+int devicemgr_findAddress(u_int16_t address);
+int devicemgr_changeAddress(u_int16_t address, u_int16_t new_address);
+void devicemgr_rawReset(u_int16_t address);
+u_int32_t devicemgr_rawState(u_int16_t address, int flap, int fullRotation, u_int32_t tick, int power);
+void devicemgr_lock();
+void devicemgr_unlock();
+void devicemgr_printFlap(int flap, int x, int y);
+int findFlap(char flap);
+int devicemgr_calibrate(int rounds, int overwrite, json_object *root);
+void devicemgr_power(json_object *req, json_object *res);
+int devicemgr_parseMove(json_object *jval, int def);
+int devicemgr_verify();
+void devicemgr_timeSync(int force);
+void devicemgr_timeSyncDue();
+int devicemgr_poll();
+void devicemgr_airtime(json_object *req, json_object *res);
+void devicemgr_verifyMetrics(json_object *res);
+int devicemgr_zoneDefine(const char *name, json_object *req, json_object *res);
+int devicemgr_zoneRemove(const char *name, json_object *res);
+int devicemgr_zoneSync(const char *name, json_object *res);
+void devicemgr_zones(json_object *res);
+int devicemgr_zoneDisplay(const char *name, int flap, int fullRotation, int *grouped);
+int devicemgr_zonePower(const char *name, int state);
+int devicemgr_zoneReset(const char *name);
\ No newline at end of file
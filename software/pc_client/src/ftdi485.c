@@ -55,3 +55,30 @@ int rs485_init(char *device, int baud) {
 
   return rs485_fd;
 }
+
+/*
+* Set 9th bit for following bytes by using mark (1) or space (0) parity.
+* Used for the multi-processor communication mode of the modules.
+* Waits until all pending bytes are sent before switching.
+*/
+int rs485_set_mark(int fd, int mark) {
+  struct termios options;
+  tcdrain(fd);
+  int result = tcgetattr(fd, &options);
+  if (result) {
+    perror("tcgetattr failed");
+    return -1;
+  }
+  options.c_cflag |= PARENB | CMSPAR;
+  if (mark) {
+    options.c_cflag |= PARODD;
+  } else {
+    options.c_cflag &= ~PARODD;
+  }
+  result = tcsetattr(fd, TCSANOW, &options);
+  if (result) {
+    perror("tcsetattr failed");
+    return -1;
+  }
+  return 0;
+}
@@ -20,4 +20,5 @@
 #define RS485TX 0
 #define RS485RX 1
 
-int rs485_init(char *device, int baud);
\ No newline at end of file
+int rs485_init(char *device, int baud);
+int rs485_set_mark(int fd, int mark);
\ No newline at end of file
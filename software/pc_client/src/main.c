@@ -27,11 +27,14 @@
 #include "devicemgr.h"
 #include "ftdi485.h"
 #include "sfbus.h"
+#include "sfbus-util.h"
 
 
 void printUsage(char *argv[])
 {
-    fprintf(stderr, "Usage: %s -p <tty> -c <command> [value]\n", argv[0]);
+    fprintf(stderr, "Usage: %s -p <tty> -c <command> [-m] [value]\n", argv[0]);
+    fprintf(stderr, "  -m  use multi-processor communication mode (9-bit bus)\n");
+    fprintf(stderr, "  -c flash -d <image.bin> -a <addr>[,<addr>...]  update firmware over the bus\n");
     exit(EXIT_FAILURE);
 }
 
@@ -46,7 +49,8 @@ int main(int argc, char *argv[])
     command = "";
     addr = "";
     data = "";
-    while ((opt = getopt(argc, argv, "p:c:a:d:")) != -1)
+    int mpcm = 0;
+    while ((opt = getopt(argc, argv, "p:c:a:d:m")) != -1)
     {
         switch (opt)
         {
@@ -62,6 +66,9 @@ int main(int argc, char *argv[])
         case 'd':
             data = optarg;
             break;
+        case 'm':
+            mpcm = 1;
+            break;
         default:
             printUsage(argv);
         }
@@ -87,6 +94,7 @@ int main(int argc, char *argv[])
 
     printf("Open device at %s\n", port);
     int fd = rs485_init(port, B19200); // setup rs485
+    sfbus_set_mpcm(fd, mpcm);
 
     if (strcmp(command, "ping") == 0)
     {
@@ -94,7 +102,7 @@ int main(int argc, char *argv[])
     }
     else if (strcmp(command, "printf") == 0)
     {
-        devicemgr_printText(data, 0, 0);
+        devicemgr_printText(data, 0, 0, 1, 0);
     }
     else if (strcmp(command, "r_eeprom") == 0)
     {
@@ -168,6 +176,35 @@ int main(int argc, char *argv[])
         sfbus_motor_power(fd, addr_int, 0);
         exit(0);
     }
+    else if (strcmp(command, "flash") == 0)
+    {
+        if (mpcm)
+        {
+            fprintf(stderr, "Firmware update requires standard bus mode\n");
+            exit(EXIT_FAILURE);
+        }
+        // comma separated address list
+        u_int16_t *addresses = malloc(sizeof(u_int16_t) * 256);
+        int count = 0;
+        char *token = strtok(addr, ",");
+        while (token != NULL && count < 256)
+        {
+            addresses[count++] = strtol(token, NULL, 10);
+            token = strtok(NULL, ",");
+        }
+        // read raw binary image (avr-objcopy -O binary)
+        FILE *file = fopen(data, "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Cannot open image %s\n", data);
+            exit(EXIT_FAILURE);
+        }
+        char *image = malloc(SFBUS_BOOT_PAGES * SFBUS_BOOT_PAGESIZE + 1);
+        int length = fread(image, 1, SFBUS_BOOT_PAGES * SFBUS_BOOT_PAGESIZE + 1, file);
+        fclose(file);
+        int ret = sfbusu_flash(fd, image, length, addresses, count);
+        exit(ret);
+    }
     else if (strcmp(command, "server") == 0)
     {
         start_console(fd);
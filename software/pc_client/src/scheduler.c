@@ -0,0 +1,201 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ * This section provides a deadline scheduler for print jobs. A job is started
+ * early enough so the text is in place at its deadline (wall clock), e.g. for
+ * clocks and departure boards.
+ */
+
+#include "scheduler.h"
+#include <pthread.h>
+#include <sys/timerfd.h>
+#include <time.h>
+
+struct SFSCHED_JOB
+{
+    u_int8_t used;
+    int64_t apply_at; // deadline, unix time in ms
+    int64_t wake_at;  // start of sending, unix time in ms
+    int x;
+    int y;
+    int full_rotation;
+    char text[SFSCHED_TEXT_LEN];
+};
+
+struct SFSCHED_JOB jobs[SFSCHED_MAXJOBS];
+struct SFSCHED_METRICS metrics;
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_t schedThread;
+int schedTimer = -1;
+
+// wall clock in ms
+int64_t scheduler_now_ms()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// arm timer for earliest pending job. jobLock must be held
+static void scheduler_arm()
+{
+    struct itimerspec timer = {0};
+    int64_t wake = 0;
+    for (int i = 0; i < SFSCHED_MAXJOBS; i++)
+    {
+        if (jobs[i].used && (wake == 0 || jobs[i].wake_at < wake))
+        {
+            wake = jobs[i].wake_at;
+        }
+    }
+    if (wake > 0)
+    {
+        timer.it_value.tv_sec = wake / 1000;
+        timer.it_value.tv_nsec = (wake % 1000) * 1000000 + 1; // never 0, which disarms
+    }
+    timerfd_settime(schedTimer, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+// print job. Deadline is converted to bus time, devices arrive at deadline
+static void scheduler_run(struct SFSCHED_JOB *job)
+{
+    int64_t wake = scheduler_now_ms();
+    devicemgr_lock();
+    int64_t now = scheduler_now_ms();
+    u_int32_t arrival = 0;
+    if (job->apply_at > now)
+    {
+        arrival = sfbus_ticks_now() + (u_int32_t)((job->apply_at - now) * 1000 / SFBUS_TICK_US);
+    }
+    int eta = devicemgr_printText(job->text, job->x, job->y, job->full_rotation, arrival);
+    int late = (int)(scheduler_now_ms() + eta - job->apply_at);
+    devicemgr_unlock();
+
+    pthread_mutex_lock(&jobLock);
+    metrics.applied++;
+    metrics.late_last_ms = late;
+    metrics.late_max_ms = metrics.applied == 1 || late > metrics.late_max_ms ? late : metrics.late_max_ms;
+    metrics.wait_last_ms = (int)(now - wake);
+    if (late > SFSCHED_TOLERANCE_MS)
+    {
+        metrics.missed++;
+        fprintf(stderr, "[WARN][scheduler] deadline missed by %i ms\n", late);
+    }
+    pthread_mutex_unlock(&jobLock);
+}
+
+static void *scheduler_loop(void *arg)
+{
+    u_int64_t expirations;
+    while (1)
+    {
+        if (read(schedTimer, &expirations, sizeof(expirations)) < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "[ERROR][scheduler] timer failed: %s\n", strerror(errno));
+            return NULL;
+        }
+        // execute all due jobs, earliest deadline first
+        while (1)
+        {
+            struct SFSCHED_JOB job;
+            int next = -1;
+            pthread_mutex_lock(&jobLock);
+            int64_t now = scheduler_now_ms();
+            for (int i = 0; i < SFSCHED_MAXJOBS; i++)
+            {
+                if (jobs[i].used && jobs[i].wake_at <= now && (next < 0 || jobs[i].apply_at < jobs[next].apply_at))
+                {
+                    next = i;
+                }
+            }
+            if (next >= 0)
+            {
+                job = jobs[next];
+                jobs[next].used = 0;
+            }
+            else
+            {
+                scheduler_arm();
+            }
+            pthread_mutex_unlock(&jobLock);
+            if (next < 0)
+            {
+                break;
+            }
+            scheduler_run(&job);
+        }
+    }
+    return NULL;
+}
+
+void scheduler_start()
+{
+    schedTimer = timerfd_create(CLOCK_REALTIME, 0);
+    if (schedTimer < 0)
+    {
+        fprintf(stderr, "[ERROR][scheduler] cannot create timer: %s\n", strerror(errno));
+        return;
+    }
+    pthread_create(&schedThread, NULL, scheduler_loop, NULL);
+}
+
+/*
+ * Queue print job with deadline apply_at (unix time in ms). Sending starts
+ * the estimated print duration (see devicemgr_printDuration) before the
+ * deadline. Call with devicemgr_lock held.
+ * returns job id, -1 if queue is full
+ */
+int scheduler_add(char *text, int x, int y, int fullRotation, int64_t apply_at)
+{
+    int duration = devicemgr_printDuration(text, x, y, fullRotation);
+    pthread_mutex_lock(&jobLock);
+    int id = -1;
+    for (int i = 0; i < SFSCHED_MAXJOBS && id < 0; i++)
+    {
+        id = jobs[i].used ? -1 : i;
+    }
+    if (id < 0 || schedTimer < 0)
+    {
+        metrics.rejected++;
+        pthread_mutex_unlock(&jobLock);
+        return -1;
+    }
+    jobs[id].used = 1;
+    jobs[id].apply_at = apply_at;
+    jobs[id].wake_at = apply_at - duration - SFSCHED_MARGIN_MS;
+    jobs[id].x = x;
+    jobs[id].y = y;
+    jobs[id].full_rotation = fullRotation;
+    strncpy(jobs[id].text, text, SFSCHED_TEXT_LEN - 1);
+    jobs[id].text[SFSCHED_TEXT_LEN - 1] = 0;
+    metrics.scheduled++;
+    scheduler_arm();
+    pthread_mutex_unlock(&jobLock);
+    printf("[INFO][scheduler] job %i: start in %i ms, deadline in %i ms\n", id,
+           (int)(jobs[id].wake_at - scheduler_now_ms()), (int)(apply_at - scheduler_now_ms()));
+    return id;
+}
+
+// add metrics and pending jobs to res
+void scheduler_metrics(json_object *res)
+{
+    pthread_mutex_lock(&jobLock);
+    int pending = 0;
+    for (int i = 0; i < SFSCHED_MAXJOBS; i++)
+    {
+        pending += jobs[i].used ? 1 : 0;
+    }
+    json_object_object_add(res, "pending", json_object_new_int(pending));
+    json_object_object_add(res, "scheduled", json_object_new_int64(metrics.scheduled));
+    json_object_object_add(res, "applied", json_object_new_int64(metrics.applied));
+    json_object_object_add(res, "missed", json_object_new_int64(metrics.missed));
+    json_object_object_add(res, "rejected", json_object_new_int64(metrics.rejected));
+    json_object_object_add(res, "late_last_ms", json_object_new_int(metrics.late_last_ms));
+    json_object_object_add(res, "late_max_ms", json_object_new_int(metrics.late_max_ms));
+    json_object_object_add(res, "wait_last_ms", json_object_new_int(metrics.wait_last_ms));
+    pthread_mutex_unlock(&jobLock);
+}
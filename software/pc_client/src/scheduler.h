@@ -0,0 +1,33 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ */
+
+#pragma once
+#include "devicemgr.h"
+
+#define SFSCHED_MAXJOBS 32      // max. pending print jobs
+#define SFSCHED_TEXT_LEN 64     // max. text length of print job
+#define SFSCHED_MARGIN_MS 200   // additional time before estimated start of sending
+#define SFSCHED_TOLERANCE_MS 20 // arrival later than deadline + tolerance is a miss
+
+// counters of deadline scheduler, see scheduler_metrics
+struct SFSCHED_METRICS
+{
+    u_int32_t scheduled; // accepted jobs
+    u_int32_t applied;   // executed jobs
+    u_int32_t missed;    // jobs that arrived after their deadline
+    u_int32_t rejected;  // jobs rejected, queue full
+    int late_last_ms;    // arrival of last job relative to deadline, negative if early
+    int late_max_ms;     // latest arrival relative to deadline
+    int wait_last_ms;    // time last job waited for the bus
+};
+
+void scheduler_start();
+int scheduler_add(char *text, int x, int y, int fullRotation, int64_t apply_at);
+void scheduler_metrics(json_object *res);
+int64_t scheduler_now_ms();
@@ -55,3 +55,146 @@ int sfbusu_write_calibration(int fd, u_int16_t address, u_int16_t data)
 
     return 0;
 }
+
+// app ping. Bootloader and application answer to ping with 0xFF
+static int sfbusu_ping(int fd, u_int16_t address)
+{
+    char *cmd = "\xFE";
+    char *buffer = malloc(64);
+    sfbus_send_frame(fd, address, strlen(cmd), cmd);
+    int len = sfbus_recv_frame_wait(fd, SFBUS_ADDR_MASTER, buffer);
+    int result = (len == 4 && *buffer == (char)0xFF) ? 0 : 1;
+    free(buffer);
+    return result;
+}
+
+// query bootloader state of all devices. addresses must be sorted
+static void sfbusu_boot_query_all(int fd, u_int16_t *addresses, int count, struct SFBUS_BOOTSTATE *states)
+{
+    struct SFBUS_BOOTSTATE *chunk = malloc(sizeof(struct SFBUS_BOOTSTATE) * SFBUS_SEQ_MAXSLOTS);
+    int i = 0;
+    while (i < count)
+    {
+        u_int16_t base = addresses[i];
+        int end = i;
+        while (end < count && addresses[end] - base < SFBUS_SEQ_MAXSLOTS)
+        {
+            end++;
+        }
+        sfbus_boot_query(fd, base, addresses[end - 1] - base + 1, chunk);
+        for (; i < end; i++)
+        {
+            states[i] = chunk[addresses[i] - base];
+        }
+    }
+    free(chunk);
+}
+
+static int sfbusu_compare_address(const void *a, const void *b)
+{
+    return *(const u_int16_t *)a - *(const u_int16_t *)b;
+}
+
+/*
+* Update firmware of devices. The image (raw binary, max. 7 KB) is broadcast
+* once, afterwards only pages reported missing are sent again.
+* Requires standard bus mode, as the bootloader does not use MPCM.
+* returns number of devices that failed the update.
+*/
+int sfbusu_flash(int fd, char *image, int length, u_int16_t *addresses, int count)
+{
+    int pages = (length + SFBUS_BOOT_PAGESIZE - 1) / SFBUS_BOOT_PAGESIZE;
+    if (length < 1 || pages > SFBUS_BOOT_PAGES)
+    {
+        fprintf(stderr, "Image size %i does not fit into application section\n", length);
+        return count;
+    }
+    char *buffer = malloc(pages * SFBUS_BOOT_PAGESIZE);
+    memset(buffer, 0xFF, pages * SFBUS_BOOT_PAGESIZE); // erased flash
+    memcpy(buffer, image, length);
+    u_int16_t crc = crc16_update(0xFFFF, buffer, pages * SFBUS_BOOT_PAGESIZE);
+    qsort(addresses, count, sizeof(u_int16_t), sfbusu_compare_address);
+    struct SFBUS_BOOTSTATE *states = malloc(sizeof(struct SFBUS_BOOTSTATE) * count);
+
+    // reset all devices into bootloader, devices already in bootloader ignore it
+    for (int i = 0; i < count; i++)
+    {
+        sfbus_enter_bootloader(fd, addresses[i]);
+    }
+    usleep(SFBUSU_BOOT_STARTUP_MS * 1000);
+    sfbus_boot_begin(fd, SFBUS_ADDR_BROADCAST, pages, crc);
+    usleep(SFBUSU_BOOT_STARTUP_MS * 1000); // state is written to eeprom
+    for (int page = 0; page < pages; page++)
+    {
+        sfbus_boot_page(fd, page, buffer + page * SFBUS_BOOT_PAGESIZE);
+    }
+
+    // resend missing pages
+    for (int round = 0; round < SFBUSU_BOOT_ROUNDS; round++)
+    {
+        u_int8_t missing[SFBUS_BOOT_BITMAP_LEN];
+        int incomplete = 0;
+        memset(missing, 0, sizeof(missing));
+        sfbusu_boot_query_all(fd, addresses, count, states);
+        for (int i = 0; i < count; i++)
+        {
+            if (states[i].valid == 0 || (states[i].status & SFBUS_BOOT_COMPLETE))
+            {
+                incomplete += states[i].valid == 0 ? 1 : 0; // query again next round
+                continue;
+            }
+            incomplete++;
+            if ((states[i].status & SFBUS_BOOT_RUNNING) == 0 || states[i].pages != pages)
+            { // begin was lost
+                sfbus_boot_begin(fd, addresses[i], pages, crc);
+                usleep(SFBUSU_BOOT_STARTUP_MS * 1000);
+                memset(missing, 0xFF, sizeof(missing));
+                continue;
+            }
+            for (int b = 0; b < SFBUS_BOOT_BITMAP_LEN; b++)
+            {
+                missing[b] |= states[i].missing[b];
+            }
+        }
+        if (incomplete == 0)
+        {
+            break;
+        }
+        int resent = 0;
+        for (int page = 0; page < pages; page++)
+        {
+            if (missing[page >> 3] & (1 << (page & 0x07)))
+            {
+                sfbus_boot_page(fd, page, buffer + page * SFBUS_BOOT_PAGESIZE);
+                resent++;
+            }
+        }
+        printf("Round %i: %i devices incomplete, %i pages resent\n", round + 1, incomplete, resent);
+    }
+
+    // verify image and start application
+    sfbus_boot_finish(fd);
+    usleep(SFBUSU_BOOT_STARTUP_MS * 1000);
+    sfbusu_boot_query_all(fd, addresses, count, states);
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (states[i].valid)
+        {
+            fprintf(stderr, "Device %i: update failed, status 0x%02X\n", addresses[i], states[i].status);
+            failed++;
+        }
+        else if (sfbusu_ping(fd, addresses[i]) != 0)
+        {
+            fprintf(stderr, "Device %i: no response after update\n", addresses[i]);
+            failed++;
+        }
+        else
+        {
+            printf("Device %i: updated\n", addresses[i]);
+        }
+    }
+    free(states);
+    free(buffer);
+    return failed;
+}
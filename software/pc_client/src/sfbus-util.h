@@ -7,10 +7,15 @@
  *
  */
 
+#pragma once
 #include "sfbus.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define SFBUSU_BOOT_STARTUP_MS 500 // wait for reset into bootloader and eeprom writes
+#define SFBUSU_BOOT_ROUNDS 8       // max. rounds to resend missing pages
+
 int sfbusu_write_address(int fd, u_int16_t current, u_int16_t new);
-int sfbusu_write_calibration(int fd, u_int16_t address, u_int16_t data);
\ No newline at end of file
+int sfbusu_write_calibration(int fd, u_int16_t address, u_int16_t data);
+int sfbusu_flash(int fd, char *image, int length, u_int16_t *addresses, int count);
@@ -11,6 +11,148 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
+
+// multi-processor communication mode: start byte is sent with 9th bit set
+int sfbus_mpcm = 0;
+// airtime accounting per bus, see sfbus_airtime_admit
+struct SFBUS_AIRTIME sfbus_air[SFBUS_AIR_BUSES];
+int sfbus_air_buses = 0;
+// share of window in percent each class may use
+int sfbus_air_limit[SFBUS_PRIO_COUNT] = {100, 85, 60};
+
+static u_int64_t sfbus_now_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u_int64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/*
+* Accounting of bus. Buses beyond SFBUS_AIR_BUSES share the last entry.
+*/
+struct SFBUS_AIRTIME *sfbus_airtime(int fd)
+{
+    for (int i = 0; i < sfbus_air_buses; i++)
+    {
+        if (sfbus_air[i].fd == fd)
+        {
+            return &sfbus_air[i];
+        }
+    }
+    if (sfbus_air_buses == SFBUS_AIR_BUSES)
+    {
+        return &sfbus_air[SFBUS_AIR_BUSES - 1];
+    }
+    struct SFBUS_AIRTIME *air = &sfbus_air[sfbus_air_buses++];
+    memset(air, 0, sizeof(struct SFBUS_AIRTIME));
+    air->fd = fd;
+    return air;
+}
+
+// add time the bus was occupied
+static void sfbus_airtime_add(int fd, u_int32_t us)
+{
+    struct SFBUS_AIRTIME *air = sfbus_airtime(fd);
+    u_int64_t index = sfbus_now_us() / (SFBUS_AIR_WINDOW_MS * 1000 / SFBUS_AIR_SLOTS);
+    int slot = index % SFBUS_AIR_SLOTS;
+    if (air->slot_index[slot] != index)
+    {
+        air->slot_index[slot] = index;
+        air->slot_us[slot] = 0;
+    }
+    air->slot_us[slot] += us;
+}
+
+/*
+* Airtime used within the last window in us.
+*/
+u_int32_t sfbus_airtime_used_us(int fd)
+{
+    struct SFBUS_AIRTIME *air = sfbus_airtime(fd);
+    u_int64_t index = sfbus_now_us() / (SFBUS_AIR_WINDOW_MS * 1000 / SFBUS_AIR_SLOTS);
+    u_int32_t used = 0;
+    for (int slot = 0; slot < SFBUS_AIR_SLOTS; slot++)
+    {
+        if (index - air->slot_index[slot] < SFBUS_AIR_SLOTS)
+        {
+            used += air->slot_us[slot];
+        }
+    }
+    return used;
+}
+
+/*
+* Admission control. A transaction of the given class is admitted if the
+* airtime of the last window plus its cost stays within the limit of the
+* class. Display traffic is always admitted, so lower classes back off
+* before it is delayed. returns 1 if admitted, 0 if it should be deferred.
+*/
+int sfbus_airtime_admit(int fd, u_int32_t cost_us, int priority)
+{
+    struct SFBUS_AIRTIME *air = sfbus_airtime(fd);
+    priority = priority < 0 || priority >= SFBUS_PRIO_COUNT ? SFBUS_PRIO_POLL : priority;
+    u_int64_t budget = (u_int64_t)SFBUS_AIR_WINDOW_MS * 10 * sfbus_air_limit[priority];
+    if (priority != SFBUS_PRIO_DISPLAY && sfbus_airtime_used_us(fd) + cost_us > budget)
+    {
+        air->deferred[priority]++;
+        return 0;
+    }
+    air->admitted[priority]++;
+    return 1;
+}
+
+/*
+* Set limit of class in percent of the window, negative values only read it.
+* returns the limit.
+*/
+int sfbus_airtime_limit(int priority, int percent)
+{
+    if (priority <= SFBUS_PRIO_DISPLAY || priority >= SFBUS_PRIO_COUNT)
+    {
+        return 100;
+    }
+    if (percent >= 0)
+    {
+        sfbus_air_limit[priority] = percent > 100 ? 100 : percent;
+    }
+    return sfbus_air_limit[priority];
+}
+
+/*
+* Enable or disable multi-processor communication mode. Must match
+* the bus mode the modules are built with.
+*/
+void sfbus_set_mpcm(int fd, int enabled)
+{
+    sfbus_mpcm = enabled;
+    if (enabled)
+    {
+        rs485_set_mark(fd, 0);
+    }
+}
+
+/*
+* Write assembled frame to bus. In multi-processor communication mode the
+* start byte is sent with the 9th bit set, all other bytes without. Modules
+* only wake up on the start byte and ignore payload of other frames.
+*/
+int sfbus_write_frame(int fd, char *frame, int length)
+{
+    sfbus_airtime_add(fd, (length * SFBUS_BITS_PER_BYTE * 1000000UL) / SFBUS_BAUD);
+    if (sfbus_mpcm == 0)
+    {
+        return write(fd, frame, length);
+    }
+    rs485_set_mark(fd, 1);
+    int result = write(fd, frame, 1);
+    rs485_set_mark(fd, 0);
+    if (result < 0)
+    {
+        return result;
+    }
+    return write(fd, frame + 1, length - 1) + 1;
+}
 
 void print_charHex(char *buffer, int length)
 {
@@ -41,16 +183,20 @@ ssize_t sfbus_recv_frame_wait(int fd, u_int16_t address, char *buffer)
 {
     ssize_t len = 0;
     int retryCount = 2;
+    u_int64_t start = sfbus_now_us();
     do
     {
         len = sfbus_recv_frame(fd, address, buffer);
         retryCount--;
         if (retryCount == 0)
         {
+            // no module is sending, only the response slot is counted
+            sfbus_airtime_add(fd, SFBUS_TURNAROUND_US);
             fprintf(stderr, "Rx timeout\n");
             return -1;
         }
     } while (len <= 0);
+    sfbus_airtime_add(fd, sfbus_now_us() - start);
     print_bufferHexRx(buffer, len - 3, address);
     return len;
 }
@@ -132,7 +278,7 @@ void sfbus_send_frame(int fd, u_int16_t address, u_int8_t length, char *buffer)
     }
     *frame = '$'; // startbyte
 
-    int result = write(fd, frame_ptr, frame_size_complete);
+    int result = sfbus_write_frame(fd, frame_ptr, frame_size_complete);
     print_bufferHexTx(frame_ptr + 5, frame_size_complete - 6, address);
     free(frame_ptr);
 }
@@ -161,7 +307,7 @@ void sfbus_send_frame_v2(int fd, u_int16_t address, u_int8_t length, char *buffe
     *(frame + (frame_size_complete - 0)) = ((crc >> 8)); // address low byte
 
     // send data
-    int result = write(fd, frame, frame_size_complete);
+    int result = sfbus_write_frame(fd, frame, frame_size_complete);
     print_bufferHexTx(frame, frame_size_complete, address);
     free(frame); // free frame buffer
 }
@@ -238,6 +384,135 @@ int sfbus_write_eeprom(int fd, u_int16_t address, char *wbuffer, char *rbuffer)
     return len;
 }
 
+/*
+* Read per-flap calibration table (SFBUS_FLAPS entries) from device.
+* returns 0 on success, else -1.
+*/
+int sfbus_read_flapcal(int fd, u_int16_t address, int8_t *table)
+{
+    char *cmd = "\xF2";
+    char *_buffer = malloc(256);
+    sfbus_send_frame(fd, address, strlen(cmd), cmd);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len != SFBUS_FLAPS + 4 || *(_buffer) != (char)0xAA)
+    {
+        printf("Invalid data!\n");
+        free(_buffer);
+        return -1;
+    }
+    memcpy(table, _buffer + 1, SFBUS_FLAPS);
+    free(_buffer);
+    return 0;
+}
+
+/*
+* Write step corrections for count flaps, starting at flap start.
+* returns 0 if the readback matches, else -1.
+*/
+int sfbus_write_flapcal(int fd, u_int16_t address, u_int8_t start, u_int8_t count, int8_t *values)
+{
+    if (start + count > SFBUS_FLAPS)
+    {
+        return -1;
+    }
+    char *cmd = malloc(3 + count);
+    *cmd = (char)0xF3; // write flap calibration command
+    *(cmd + 1) = start;
+    *(cmd + 2) = count;
+    memcpy(cmd + 3, values, count);
+    sfbus_send_frame(fd, address, 3 + count, cmd);
+    free(cmd);
+    // module responds after writing count bytes to EEPROM
+    tcdrain(fd);
+    usleep(count * SFBUS_EEPROM_WRITE_US);
+    char *_buffer = malloc(256);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len != SFBUS_FLAPS + 4 || *(_buffer) != (char)0xAA)
+    { // first write initializes the whole table, wait for it and read back instead
+        usleep((SFBUS_FLAPS + 1) * SFBUS_EEPROM_WRITE_US);
+        tcflush(fd, TCIFLUSH); // late response
+        *(_buffer) = (char)0xAA;
+        len = sfbus_read_flapcal(fd, address, (int8_t *)(_buffer + 1)) < 0 ? -1 : SFBUS_FLAPS + 4;
+    }
+    if (len != SFBUS_FLAPS + 4 || memcmp(_buffer + 1 + start, values, count) != 0)
+    {
+        printf("Invalid data!\n");
+        free(_buffer);
+        return -1;
+    }
+    free(_buffer);
+    return 0;
+}
+
+/*
+* Read group table (SFBUS_GROUPS entries) from device. Unused entries are 0xFFFF.
+* returns 0 on success, else -1.
+*/
+int sfbus_read_groups(int fd, u_int16_t address, u_int16_t *groups)
+{
+    char *cmd = "\xF4";
+    char *_buffer = malloc(256);
+    sfbus_send_frame(fd, address, strlen(cmd), cmd);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len != SFBUS_GROUPS * 2 + 4 || *(_buffer) != (char)0xAA)
+    {
+        printf("Invalid data!\n");
+        free(_buffer);
+        return -1;
+    }
+    for (int i = 0; i < SFBUS_GROUPS; i++)
+    {
+        groups[i] = ((*(_buffer + 1 + i * 2) & 0xFF) << 8) | (*(_buffer + 2 + i * 2) & 0xFF);
+    }
+    free(_buffer);
+    return 0;
+}
+
+/*
+* Replace group table of device with count group addresses (SFBUS_ADDR_GROUP_MIN
+* to SFBUS_ADDR_GROUP_MAX), remaining entries are cleared.
+* returns 0 if the readback matches, else -1.
+*/
+int sfbus_write_groups(int fd, u_int16_t address, u_int16_t *groups, u_int8_t count)
+{
+    if (count > SFBUS_GROUPS)
+    {
+        return -1;
+    }
+    char cmd[2 + SFBUS_GROUPS * 2];
+    cmd[0] = (char)0xF5; // write group table
+    cmd[1] = count;
+    for (int i = 0; i < count; i++)
+    {
+        cmd[2 + i * 2] = (groups[i] >> 8) & 0xFF;
+        cmd[3 + i * 2] = (groups[i] >> 0) & 0xFF;
+    }
+    sfbus_send_frame(fd, address, 2 + count * 2, cmd);
+    // wait for readback
+    u_int16_t readback[SFBUS_GROUPS];
+    char *_buffer = malloc(256);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len != SFBUS_GROUPS * 2 + 4 || *(_buffer) != (char)0xAA)
+    {
+        printf("Invalid data!\n");
+        free(_buffer);
+        return -1;
+    }
+    for (int i = 0; i < SFBUS_GROUPS; i++)
+    {
+        readback[i] = ((*(_buffer + 1 + i * 2) & 0xFF) << 8) | (*(_buffer + 2 + i * 2) & 0xFF);
+    }
+    free(_buffer);
+    for (int i = 0; i < SFBUS_GROUPS; i++)
+    {
+        if (readback[i] != (i < count ? groups[i] : 0xFFFF))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int sfbus_display(int fd, u_int16_t address, u_int8_t flap)
 {
     char *cmd = malloc(5);
@@ -258,6 +533,269 @@ int sfbus_display_full(int fd, u_int16_t address, u_int8_t flap)
     return 0;
 }
 
+/*
+* Stage flap on device. The device does not move until a commit is received.
+*/
+int sfbus_stage(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation)
+{
+    char *cmd = malloc(5);
+    *cmd = (char)0x12; // stage command
+    if (fullRotation > 0)
+    {
+        *cmd = (char)0x13; // stage command with full rotation
+    }
+    *(cmd + 1) = flap;
+    sfbus_send_frame(fd, address, 2, cmd);
+    free(cmd);
+    return 0;
+}
+
+/*
+* Stage flap on device with sequence number, see sfbus_send_seq.
+*/
+int sfbus_stage_seq(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int8_t seq)
+{
+    char cmd[2];
+    cmd[0] = fullRotation > 0 ? (char)0x13 : (char)0x12;
+    cmd[1] = flap;
+    sfbus_send_seq(fd, address, seq, cmd, 2);
+    return 0;
+}
+
+/*
+* Display flap at given bus time with sequence number, see sfbus_display_at
+* and sfbus_send_seq.
+*/
+int sfbus_display_at_seq(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int32_t tick,
+                         u_int8_t seq)
+{
+    char cmd[7];
+    cmd[0] = (char)0x16; // display at command
+    cmd[1] = flap;
+    cmd[2] = fullRotation > 0 ? 1 : 0;
+    cmd[3] = (tick >> 24) & 0xFF;
+    cmd[4] = (tick >> 16) & 0xFF;
+    cmd[5] = (tick >> 8) & 0xFF;
+    cmd[6] = (tick >> 0) & 0xFF;
+    sfbus_send_seq(fd, address, seq, cmd, 7);
+    return 0;
+}
+
+/*
+* Broadcast commit. All devices with a staged flap start moving at once.
+*/
+void sfbus_commit(int fd)
+{
+    char *cmd = "\x14";
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, strlen(cmd), cmd);
+}
+
+/*
+* Send command (opcode + arguments) with sequence number. The device remembers
+* the last applied sequence numbers and skips duplicates, so lost commands can
+* be resent safely. Use sfbus_seq_collect to check which commands were applied.
+*/
+void sfbus_send_seq(int fd, u_int16_t address, u_int8_t seq, char *cmd, u_int8_t length)
+{
+    char *frame = malloc(length + 2);
+    *frame = (char)0x41; // sequence command
+    *(frame + 1) = seq;
+    memcpy(frame + 2, cmd, length);
+    sfbus_send_frame(fd, address, length + 2, frame);
+    free(frame);
+}
+
+// set deadline to now + ms
+static void sfbus_deadline(struct timespec *deadline, u_int64_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    u_int64_t wait_ns = ms * 1000000ULL;
+    deadline->tv_sec += wait_ns / 1000000000ULL;
+    deadline->tv_nsec += wait_ns % 1000000000ULL;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static int sfbus_deadline_passed(struct timespec *deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/*
+* Collect sequence state of devices base to base + count - 1 with a single
+* broadcast. Each device answers in its own slot. states must hold count
+* entries, devices without answer are marked invalid. returns number of
+* answering devices.
+*/
+int sfbus_seq_collect(int fd, u_int16_t base, u_int8_t count, struct SFBUS_SEQSTATE *states)
+{
+    char cmd[4];
+    char *_buffer = malloc(256);
+    int answered = 0;
+    memset(states, 0, sizeof(struct SFBUS_SEQSTATE) * count);
+    cmd[0] = (char)0x42; // sequence state query
+    cmd[1] = (base >> 8) & 0xFF;
+    cmd[2] = (base >> 0) & 0xFF;
+    cmd[3] = count;
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, 4, cmd);
+    // read answers until last slot has passed
+    struct timespec deadline;
+    u_int64_t start = sfbus_now_us();
+    sfbus_deadline(&deadline, (u_int64_t)count * SFBUS_SEQ_SLOT_MS + 50);
+    do
+    {
+        ssize_t len = sfbus_recv_frame(fd, SFBUS_ADDR_MASTER, _buffer);
+        if (len - 3 == 5)
+        {
+            u_int16_t address = ((*(_buffer + 0) & 0xFF) << 8) | (*(_buffer + 1) & 0xFF);
+            if (address >= base && address - base < count)
+            {
+                struct SFBUS_SEQSTATE *state = &states[address - base];
+                state->valid = 1;
+                state->last = *(_buffer + 2);
+                state->history = ((*(_buffer + 3) & 0xFF) << 8) | (*(_buffer + 4) & 0xFF);
+                answered++;
+            }
+        }
+    } while (!sfbus_deadline_passed(&deadline));
+    sfbus_airtime_add(fd, sfbus_now_us() - start); // response slots
+    free(_buffer);
+    return answered;
+}
+
+/*
+* Check if sequence number was applied by device. Sequence numbers older
+* than SFBUS_SEQ_HISTORY cannot be checked and are reported as not applied.
+*/
+int sfbus_seq_applied(struct SFBUS_SEQSTATE *state, u_int8_t seq)
+{
+    u_int8_t age = state->last - seq;
+    if (state->valid == 0 || age >= SFBUS_SEQ_HISTORY)
+    {
+        return 0;
+    }
+    return (state->history >> age) & 1;
+}
+
+/*
+* Calculate wire time of a frame with the given payload length in us.
+*/
+u_int32_t sfbus_frame_time_us(u_int8_t length)
+{
+    u_int32_t bytes = length + 6; // header, address and stop byte
+    return (bytes * SFBUS_BITS_PER_BYTE * 1000000UL) / SFBUS_BAUD;
+}
+
+/*
+* Estimated airtime of a request with tx_length payload bytes and a
+* response with rx_length payload bytes (0 = no response).
+*/
+u_int32_t sfbus_transaction_us(u_int8_t tx_length, u_int8_t rx_length)
+{
+    u_int32_t us = sfbus_frame_time_us(tx_length);
+    if (rx_length > 0)
+    {
+        us += SFBUS_TURNAROUND_US + sfbus_frame_time_us(rx_length);
+    }
+    return us;
+}
+
+/*
+* Returns current bus time in module ticks. Bus time starts at first call.
+*/
+u_int32_t sfbus_ticks_now()
+{
+    static struct timespec epoch = {0, 0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (epoch.tv_sec == 0 && epoch.tv_nsec == 0)
+    {
+        epoch = now;
+    }
+    u_int64_t elapsed_us = (u_int64_t)(now.tv_sec - epoch.tv_sec) * 1000000ULL;
+    elapsed_us += (now.tv_nsec - epoch.tv_nsec) / 1000;
+    return (u_int32_t)(elapsed_us / SFBUS_TICK_US);
+}
+
+/*
+* Broadcast bus time to all devices. The sent tick is the bus time at which
+* the frame is completely received by the devices.
+*/
+void sfbus_time_sync(int fd)
+{
+    char *cmd = malloc(5);
+    u_int32_t tick = sfbus_ticks_now() + (sfbus_frame_time_us(5) + SFBUS_TICK_US / 2) / SFBUS_TICK_US;
+    *cmd = (char)0x15; // sync command
+    *(cmd + 1) = (tick >> 24) & 0xFF;
+    *(cmd + 2) = (tick >> 16) & 0xFF;
+    *(cmd + 3) = (tick >> 8) & 0xFF;
+    *(cmd + 4) = (tick >> 0) & 0xFF;
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, 5, cmd);
+    tcdrain(fd); // wait until frame is sent, so the next frame does not delay it
+    free(cmd);
+}
+
+/*
+* Display flap at given bus time (see sfbus_ticks_now).
+* Devices must be synced with sfbus_time_sync before.
+*/
+int sfbus_display_at(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int32_t tick)
+{
+    char *cmd = malloc(7);
+    *cmd = (char)0x16; // display at command
+    *(cmd + 1) = flap;
+    *(cmd + 2) = fullRotation > 0 ? 1 : 0;
+    *(cmd + 3) = (tick >> 24) & 0xFF;
+    *(cmd + 4) = (tick >> 16) & 0xFF;
+    *(cmd + 5) = (tick >> 8) & 0xFF;
+    *(cmd + 6) = (tick >> 0) & 0xFF;
+    sfbus_send_frame(fd, address, 7, cmd);
+    free(cmd);
+    return 0;
+}
+
+/*
+* Append flaps to the sequence queue of the device. Each flap is shown for its
+* dwell time (ms) before the next one is applied. At most SFBUS_QUEUE_LEN
+* entries can be queued, returns -1 if count exceeds this or a flap is invalid.
+*/
+int sfbus_enqueue(int fd, u_int16_t address, u_int8_t *flaps, u_int16_t *dwell_ms, u_int8_t count)
+{
+    if (count > SFBUS_QUEUE_LEN)
+    {
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (flaps[i] >= SFBUS_FLAPS)
+        {
+            return -1;
+        }
+    }
+    char *cmd = malloc(2 + count * 3);
+    *cmd = (char)0x17; // enqueue command
+    *(cmd + 1) = count;
+    for (int i = 0; i < count; i++)
+    {
+        u_int32_t dwell = ((u_int32_t)dwell_ms[i] * 1000) / SFBUS_TICK_US;
+        if (dwell > 0xFFFF)
+        {
+            dwell = 0xFFFF;
+        }
+        *(cmd + 2 + i * 3) = flaps[i];
+        *(cmd + 3 + i * 3) = (dwell >> 8) & 0xFF;
+        *(cmd + 4 + i * 3) = (dwell >> 0) & 0xFF;
+    }
+    sfbus_send_frame(fd, address, 2 + count * 3, cmd);
+    free(cmd);
+    return 0;
+}
+
 u_int8_t sfbus_read_status(int fd, u_int16_t address, double *voltage, u_int32_t *counter)
 {
     char *cmd = "\xF8";
@@ -279,12 +817,264 @@ u_int8_t sfbus_read_status(int fd, u_int16_t address, double *voltage, u_int32_t
     return *_buffer;
 }
 
+/*
+* Read home error history (newest first) of device. Up to SFBUS_ERROR_DATASETS
+* entries are written to deltas. If clear is set, the history is cleared afterwards.
+* returns number of entries or -1 on error.
+*/
+int sfbus_read_errors(int fd, u_int16_t address, int16_t *deltas, u_int8_t clear)
+{
+    char *cmd = malloc(2);
+    *cmd = (char)0xF9; // read error history command
+    *(cmd + 1) = clear;
+    sfbus_send_frame(fd, address, 2, cmd);
+    free(cmd);
+    char *_buffer = malloc(256);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len < 5 || *(_buffer) != (char)0xAA)
+    {
+        free(_buffer);
+        return -1;
+    }
+    int count = *(_buffer + 1) & 0xFF;
+    if (count > SFBUS_ERROR_DATASETS || len != count * 2 + 5)
+    {
+        free(_buffer);
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        deltas[i] = (int16_t)(((*(_buffer + 2 + i * 2) & 0xFF) << 8) | (*(_buffer + 3 + i * 2) & 0xFF));
+    }
+    free(_buffer);
+    return count;
+}
+
+// convert raw ADC reading to voltage
+double sfbus_raw_to_voltage(u_int16_t raw)
+{
+    return ((double)raw / 1024) * 55;
+}
+
+/*
+* Read extended status with voltage statistics. If reset is set, the device
+* starts a new statistics window.
+* returns 0 on success, -1 on timeout and -2 if the device does not support it.
+*/
+int sfbus_read_status_ext(int fd, u_int16_t address, struct SFBUS_STATUS *status, u_int8_t reset)
+{
+    char *cmd = malloc(2);
+    *cmd = (char)0xFA; // read extended status command
+    *(cmd + 1) = reset;
+    sfbus_send_frame(fd, address, 2, cmd);
+    free(cmd);
+    char *_buffer = malloc(256);
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, _buffer);
+    if (len < 0)
+    {
+        free(_buffer);
+        return -1;
+    }
+    if (len != 18 && len != 19)
+    {
+        free(_buffer);
+        return -2; // old firmware responds with invalid command
+    }
+    u_int16_t values[5];
+    for (int i = 0; i < 5; i++)
+    {
+        int pos = i == 0 ? 1 : 5 + i * 2; // voltage, min, max, avg, sags
+        values[i] = ((*(_buffer + pos) & 0xFF) << 8) | (*(_buffer + pos + 1) & 0xFF);
+    }
+    status->status = *_buffer;
+    status->voltage = sfbus_raw_to_voltage(values[0]);
+    status->counter = ((*(_buffer + 3) & 0xFF) << 24) | ((*(_buffer + 4) & 0xFF) << 16) |
+                      ((*(_buffer + 5) & 0xFF) << 8) | (*(_buffer + 6) & 0xFF);
+    status->voltage_min = sfbus_raw_to_voltage(values[1]);
+    status->voltage_max = sfbus_raw_to_voltage(values[2]);
+    status->voltage_avg = sfbus_raw_to_voltage(values[3]);
+    status->sags = values[4];
+    status->flap = len == 19 ? (u_int8_t) * (_buffer + 15) : -1; // position readback of newer firmware
+    free(_buffer);
+    return 0;
+}
+
+/*
+* Start new compound request to address. Records are added with sfbus_multi_add
+* and executed by the device in order after sfbus_multi_send.
+*/
+void sfbus_multi_init(struct SFBUS_MULTI *multi, u_int16_t address)
+{
+    multi->address = address;
+    multi->payload[0] = (char)0x40; // multi command
+    multi->length = 1;
+    multi->records = 0;
+}
+
+/*
+* Add command (opcode + arguments) to compound request.
+* returns -1 if the record does not fit into the frame.
+*/
+int sfbus_multi_add(struct SFBUS_MULTI *multi, char *cmd, u_int8_t length)
+{
+    if (length == 0 || multi->length + 1 + length > SFBUS_MAX_PAYLOAD)
+    {
+        return -1;
+    }
+    multi->payload[multi->length] = length;
+    memcpy(multi->payload + multi->length + 1, cmd, length);
+    multi->length += length + 1;
+    multi->records++;
+    return 0;
+}
+
+/*
+* Send compound request. If response is not NULL, the combined response is
+* read into it (at least 256 bytes). returns length of response or -1 on
+* timeout. Only use response for requests with at least one record that
+* produces output.
+*/
+int sfbus_multi_send(int fd, struct SFBUS_MULTI *multi, char *response)
+{
+    sfbus_send_frame(fd, multi->address, multi->length, multi->payload);
+    if (response == NULL || multi->address == SFBUS_ADDR_BROADCAST)
+    {
+        return 0;
+    }
+    int len = sfbus_recv_frame_wait(fd, 0xFFFF, response);
+    if (len < 0)
+    {
+        return -1;
+    }
+    return len;
+}
+
+/*
+* Find response of the first record with opcode in combined response.
+* returns length of the record response and sets record to its start,
+* -1 if not found.
+*/
+int sfbus_multi_find(char *response, int length, u_int8_t opcode, char **record)
+{
+    int pos = 0;
+    while (pos + 2 <= length)
+    {
+        u_int8_t rec_len = *(response + pos + 1);
+        if (pos + 2 + rec_len > length)
+        {
+            break;
+        }
+        if ((u_int8_t) * (response + pos) == opcode)
+        {
+            *record = response + pos + 2;
+            return rec_len;
+        }
+        pos += rec_len + 2;
+    }
+    return -1;
+}
+
 void sfbus_reset_device(int fd, u_int16_t address)
 {
     char *cmd = "\x30";
     sfbus_send_frame(fd, address, strlen(cmd), cmd);
 }
 
+/*
+* Reset device into bootloader. The device stays in the bootloader until
+* a new image is verified with sfbus_boot_finish.
+*/
+void sfbus_enter_bootloader(int fd, u_int16_t address)
+{
+    char *cmd = "\x31";
+    sfbus_send_frame(fd, address, strlen(cmd), cmd);
+}
+
+/*
+* Announce new image to bootloader. Clears all received pages.
+* Use SFBUS_ADDR_BROADCAST to start the update on all devices.
+*/
+void sfbus_boot_begin(int fd, u_int16_t address, u_int8_t pages, u_int16_t crc)
+{
+    char cmd[4];
+    cmd[0] = (char)0x50; // begin update
+    cmd[1] = pages;
+    cmd[2] = (crc >> 8) & 0xFF;
+    cmd[3] = (crc >> 0) & 0xFF;
+    sfbus_send_frame(fd, address, 4, cmd);
+}
+
+/*
+* Broadcast one page (SFBUS_BOOT_PAGESIZE bytes) of the image. Waits until the
+* devices have programmed the page, as they cannot receive meanwhile.
+*/
+void sfbus_boot_page(int fd, u_int8_t page, char *data)
+{
+    char cmd[SFBUS_BOOT_PAGESIZE + 4];
+    u_int16_t crc = crc16_update(0xFFFF, data, SFBUS_BOOT_PAGESIZE);
+    cmd[0] = (char)0x51; // page data
+    cmd[1] = page;
+    memcpy(cmd + 2, data, SFBUS_BOOT_PAGESIZE);
+    cmd[SFBUS_BOOT_PAGESIZE + 2] = (crc >> 8) & 0xFF;
+    cmd[SFBUS_BOOT_PAGESIZE + 3] = (crc >> 0) & 0xFF;
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, SFBUS_BOOT_PAGESIZE + 4, cmd);
+    tcdrain(fd);
+    usleep(SFBUS_BOOT_PROG_MS * 1000);
+}
+
+/*
+* Collect bootloader state of devices base to base + count - 1 with a single
+* broadcast. Each device answers in its own slot. states must hold count
+* entries, devices without answer are marked invalid. returns number of
+* answering devices.
+*/
+int sfbus_boot_query(int fd, u_int16_t base, u_int8_t count, struct SFBUS_BOOTSTATE *states)
+{
+    char cmd[4];
+    char *_buffer = malloc(256);
+    int answered = 0;
+    memset(states, 0, sizeof(struct SFBUS_BOOTSTATE) * count);
+    cmd[0] = (char)0x52; // bootloader query
+    cmd[1] = (base >> 8) & 0xFF;
+    cmd[2] = (base >> 0) & 0xFF;
+    cmd[3] = count;
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, 4, cmd);
+    // read answers until last slot has passed
+    struct timespec deadline;
+    u_int64_t start = sfbus_now_us();
+    sfbus_deadline(&deadline, (u_int64_t)count * SFBUS_BOOT_SLOT_MS + 50);
+    do
+    {
+        ssize_t len = sfbus_recv_frame(fd, SFBUS_ADDR_MASTER, _buffer);
+        if (len - 3 == 4 + SFBUS_BOOT_BITMAP_LEN)
+        {
+            u_int16_t address = ((*(_buffer + 0) & 0xFF) << 8) | (*(_buffer + 1) & 0xFF);
+            if (address >= base && address - base < count)
+            {
+                struct SFBUS_BOOTSTATE *state = &states[address - base];
+                state->valid = 1;
+                state->status = *(_buffer + 2);
+                state->pages = *(_buffer + 3);
+                memcpy(state->missing, _buffer + 4, SFBUS_BOOT_BITMAP_LEN);
+                answered++;
+            }
+        }
+    } while (!sfbus_deadline_passed(&deadline));
+    sfbus_airtime_add(fd, sfbus_now_us() - start); // response slots
+    free(_buffer);
+    return answered;
+}
+
+/*
+* Verify image on all devices and start the application. Devices with
+* a CRC mismatch stay in the bootloader and report SFBUS_BOOT_CRCERR.
+*/
+void sfbus_boot_finish(int fd)
+{
+    char *cmd = "\x53";
+    sfbus_send_frame(fd, SFBUS_ADDR_BROADCAST, strlen(cmd), cmd);
+}
+
 void sfbus_motor_power(int fd, u_int16_t address, u_int8_t state)
 {
     char *cmd = "\x20";
@@ -297,10 +1087,17 @@ void sfbus_motor_power(int fd, u_int16_t address, u_int8_t state)
 
 u_int16_t calc_CRC16(char *buffer, u_int8_t len)
 {
-    u_int16_t crc16 = 0xFFFF;
-    for (u_int8_t pos = 0; pos < len; pos++)
+    return crc16_update(0xFFFF, buffer, len);
+}
+
+/*
+* Continue CRC16 (MODBUS) calculation over len bytes. Start with 0xFFFF.
+*/
+u_int16_t crc16_update(u_int16_t crc16, char *buffer, int len)
+{
+    for (int pos = 0; pos < len; pos++)
     {
-        char byte_value = *(buffer); // read byte after byte from buffer
+        u_int8_t byte_value = *(buffer); // read byte after byte from buffer
         buffer++;
 
         crc16 ^= byte_value; // XOR byte into least sig. byte of crc
@@ -318,4 +1115,4 @@ u_int16_t calc_CRC16(char *buffer, u_int8_t len)
         }
     }
     return crc16;
-}
\ No newline at end of file
+}
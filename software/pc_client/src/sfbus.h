@@ -7,18 +7,142 @@
  *
  */
 
+#pragma once
 #include "ftdi485.h"
 
+#define SFBUS_ADDR_MASTER 0xFFFF    // responses are sent to this address
+#define SFBUS_ADDR_BROADCAST 0xFFFE // frames to this address are processed by all nodes
+#define SFBUS_ADDR_GROUP_MIN 0xFF00 // frames to group addresses are processed by all members, no response
+#define SFBUS_ADDR_GROUP_MAX 0xFFFD
+#define SFBUS_GROUPS 8              // max. groups per module
+
+#define SFBUS_BAUD 19200            // bus baud rate
+#define SFBUS_BITS_PER_BYTE 10      // start + 8 data + stop bit
+#define SFBUS_TICK_US 2324          // module tick period: (OCR1A + 1) * 64 / F_CPU
+#define SFBUS_QUEUE_LEN 8           // length of flap sequence queue on module
+#define SFBUS_FLAPS 45              // amount of flaps per module
+#define SFBUS_ERROR_DATASETS 8      // length of home error history on module
+#define SFBUS_MAX_PAYLOAD 64        // payload buffer size on module
+#define SFBUS_SEQ_HISTORY 16        // amount of sequence numbers tracked by module
+#define SFBUS_SEQ_SLOT_MS 10        // response slot length of sequence state query
+#define SFBUS_SEQ_MAXSLOTS 64       // max. addresses per sequence state query
+#define SFBUS_BOOT_PAGESIZE 64      // flash page size of module
+#define SFBUS_BOOT_PAGES 112        // pages of application section (0x1C00 bytes)
+#define SFBUS_BOOT_BITMAP_LEN 14    // bytes of page bitmap in query response
+#define SFBUS_BOOT_SLOT_MS 20       // response slot length of bootloader query
+#define SFBUS_BOOT_PROG_MS 12       // pause after page, module cannot receive while programming
+#define SFBUS_BOOT_RUNNING 0x01     // bootloader status: update started
+#define SFBUS_BOOT_COMPLETE 0x02    // bootloader status: all pages received
+#define SFBUS_BOOT_CRCERR 0x04      // bootloader status: image crc mismatch
+#define SFBUS_EEPROM_WRITE_US 8500  // time of one EEPROM byte write on module, incl. erase
+#define SFBUS_TURNAROUND_US 3000    // response delay of module, incl. switching bus direction
+#define SFBUS_AIR_WINDOW_MS 1000    // airtime is measured over this window
+#define SFBUS_AIR_SLOTS 10          // window is moved in steps of window / slots
+#define SFBUS_AIR_BUSES 4           // max. buses (descriptors) with separate accounting
+
+// traffic classes of admission control, see sfbus_airtime_admit
+enum SFBUS_PRIORITY
+{
+    SFBUS_PRIO_DISPLAY = 0, // moves and their confirmation, always admitted
+    SFBUS_PRIO_CHECK = 1,   // move verification
+    SFBUS_PRIO_POLL = 2,    // status polling
+    SFBUS_PRIO_COUNT = 3
+};
+
+// airtime accounting of one bus
+struct SFBUS_AIRTIME
+{
+    int fd;                                // descriptor of bus, -1 if unused
+    u_int64_t slot_index[SFBUS_AIR_SLOTS]; // slot number since start of monotonic clock
+    u_int32_t slot_us[SFBUS_AIR_SLOTS];    // airtime used in slot
+    u_int32_t admitted[SFBUS_PRIO_COUNT];  // admitted transactions per class
+    u_int32_t deferred[SFBUS_PRIO_COUNT];  // rejected or deferred transactions per class
+};
+
+// applied sequence numbers of a device, see sfbus_seq_collect
+struct SFBUS_SEQSTATE
+{
+    u_int8_t valid;    // device answered
+    u_int8_t last;     // highest applied sequence number
+    u_int16_t history; // bit n set if last - n was applied
+};
+
+// bootloader state of a device, see sfbus_boot_query
+struct SFBUS_BOOTSTATE
+{
+    u_int8_t valid;  // device answered
+    u_int8_t status; // SFBUS_BOOT_* flags
+    u_int8_t pages;  // pages of image announced with begin
+    u_int8_t missing[SFBUS_BOOT_BITMAP_LEN]; // bit set if page is missing
+};
+
+// compound request, see sfbus_multi_init
+struct SFBUS_MULTI
+{
+    u_int16_t address;
+    u_int8_t length;  // used payload bytes
+    u_int8_t records; // amount of records in payload
+    char payload[SFBUS_MAX_PAYLOAD];
+};
+
+// extended device status, see sfbus_read_status_ext
+struct SFBUS_STATUS
+{
+    u_int8_t status;
+    double voltage;     // last voltage reading
+    u_int32_t counter;  // rotation counter
+    double voltage_min; // lowest voltage in window
+    double voltage_max; // highest voltage in window
+    double voltage_avg; // average voltage in window
+    u_int16_t sags;     // voltage sag events in window
+    int flap;           // flap shown or moved to, -1 if not supported by firmware
+};
+
 ssize_t sfbus_recv_frame(int fd, u_int16_t address, char *buffer);
 ssize_t sfbus_recv_frame_wait(int fd, u_int16_t address, char *buffer);
 void sfbus_send_frame(int fd, u_int16_t address, u_int8_t length, char *buffer);
+void sfbus_set_mpcm(int fd, int enabled);
 void print_charHex(char *buffer, int length);
 int sfbus_ping(int fd, u_int16_t address);
 int sfbus_read_eeprom(int fd, u_int16_t address, char* buffer);
 int sfbus_write_eeprom(int fd, u_int16_t address, char* wbuffer, char *rbuffer);
 int sfbus_display(int fd, u_int16_t address, u_int8_t flap);
 int sfbus_display_full(int fd, u_int16_t address, u_int8_t flap);
+int sfbus_stage(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation);
+int sfbus_stage_seq(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int8_t seq);
+int sfbus_display_at_seq(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int32_t tick,
+                         u_int8_t seq);
+void sfbus_commit(int fd);
+void sfbus_send_seq(int fd, u_int16_t address, u_int8_t seq, char *cmd, u_int8_t length);
+int sfbus_seq_collect(int fd, u_int16_t base, u_int8_t count, struct SFBUS_SEQSTATE *states);
+int sfbus_seq_applied(struct SFBUS_SEQSTATE *state, u_int8_t seq);
+u_int32_t sfbus_frame_time_us(u_int8_t length);
+u_int32_t sfbus_transaction_us(u_int8_t tx_length, u_int8_t rx_length);
+struct SFBUS_AIRTIME *sfbus_airtime(int fd);
+u_int32_t sfbus_airtime_used_us(int fd);
+int sfbus_airtime_admit(int fd, u_int32_t cost_us, int priority);
+int sfbus_airtime_limit(int priority, int percent);
+u_int32_t sfbus_ticks_now();
+void sfbus_time_sync(int fd);
+int sfbus_display_at(int fd, u_int16_t address, u_int8_t flap, u_int8_t fullRotation, u_int32_t tick);
+int sfbus_read_flapcal(int fd, u_int16_t address, int8_t *table);
+int sfbus_write_flapcal(int fd, u_int16_t address, u_int8_t start, u_int8_t count, int8_t *values);
+int sfbus_read_groups(int fd, u_int16_t address, u_int16_t *groups);
+int sfbus_write_groups(int fd, u_int16_t address, u_int16_t *groups, u_int8_t count);
+int sfbus_enqueue(int fd, u_int16_t address, u_int8_t *flaps, u_int16_t *dwell_ms, u_int8_t count);
 u_int8_t sfbus_read_status(int fd, u_int16_t address, double *voltage, u_int32_t *counter);
+int sfbus_read_errors(int fd, u_int16_t address, int16_t *deltas, u_int8_t clear);
+int sfbus_read_status_ext(int fd, u_int16_t address, struct SFBUS_STATUS *status, u_int8_t reset);
+void sfbus_multi_init(struct SFBUS_MULTI *multi, u_int16_t address);
+int sfbus_multi_add(struct SFBUS_MULTI *multi, char *cmd, u_int8_t length);
+int sfbus_multi_send(int fd, struct SFBUS_MULTI *multi, char *response);
+int sfbus_multi_find(char *response, int length, u_int8_t opcode, char **record);
 void sfbus_reset_device(int fd, u_int16_t address);
+void sfbus_enter_bootloader(int fd, u_int16_t address);
+void sfbus_boot_begin(int fd, u_int16_t address, u_int8_t pages, u_int16_t crc);
+void sfbus_boot_page(int fd, u_int8_t page, char *data);
+int sfbus_boot_query(int fd, u_int16_t base, u_int8_t count, struct SFBUS_BOOTSTATE *states);
+void sfbus_boot_finish(int fd);
 void sfbus_motor_power(int fd, u_int16_t address, u_int8_t state);
-u_int16_t calc_CRC16(char *buffer, u_int8_t len);
\ No newline at end of file
+u_int16_t calc_CRC16(char *buffer, u_int8_t len);
+u_int16_t crc16_update(u_int16_t crc16, char *buffer, int len);
\ No newline at end of file
@@ -0,0 +1,280 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ * This section keeps a time series of status reads per device in fixed
+ * memory. Reads are aggregated into buckets of 1s, 1min and 1h, so voltage
+ * drops or stuck motors can be traced back without an external database.
+ * Series are only accessed with the bus lock held (see devicemgr_lock).
+ */
+
+#include "telemetry.h"
+#include <pthread.h>
+#include <time.h>
+
+// bucket length in s and amount of buckets per tier
+static const struct
+{
+    int resolution;
+    int length;
+} tiers[SFTELEM_TIERS] = {{1, 120}, {60, 120}, {3600, 168}};
+
+// series per device id, allocated on first status read
+struct SFTELEM_SERIES **series = NULL;
+int seriesCapacity = 0;
+int pollInterval = SFTELEM_POLL_DEF;
+pthread_mutex_t pollLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pollCond = PTHREAD_COND_INITIALIZER;
+pthread_t pollThread;
+
+static int tierOffset(int tier)
+{
+    int offset = 0;
+    for (int i = 0; i < tier; i++)
+    {
+        offset += tiers[i].length;
+    }
+    return offset;
+}
+
+// series of device, created if create is set. returns NULL if not available
+static struct SFTELEM_SERIES *seriesGet(int id, int create)
+{
+    if (id < 0)
+    {
+        return NULL;
+    }
+    if (id >= seriesCapacity)
+    {
+        if (!create)
+        {
+            return NULL;
+        }
+        int capacity = seriesCapacity < 64 ? 64 : seriesCapacity;
+        while (capacity <= id)
+        {
+            capacity *= 2;
+        }
+        struct SFTELEM_SERIES **grown = realloc(series, sizeof(struct SFTELEM_SERIES *) * capacity);
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        memset(grown + seriesCapacity, 0, sizeof(struct SFTELEM_SERIES *) * (capacity - seriesCapacity));
+        series = grown;
+        seriesCapacity = capacity;
+    }
+    if (series[id] == NULL && create)
+    {
+        struct SFTELEM_SERIES *s = calloc(1, sizeof(struct SFTELEM_SERIES));
+        if (s == NULL)
+        {
+            return NULL;
+        }
+        s->buckets = calloc(tierOffset(SFTELEM_TIERS), sizeof(struct SFTELEM_BUCKET));
+        if (s->buckets == NULL)
+        {
+            free(s);
+            return NULL;
+        }
+        series[id] = s;
+    }
+    return series[id];
+}
+
+// bucket of tier containing time now. starts a new bucket, replacing the oldest one
+static struct SFTELEM_BUCKET *bucketAt(struct SFTELEM_SERIES *s, int tier, u_int32_t now)
+{
+    struct SFTELEM_BUCKET *ring = s->buckets + tierOffset(tier);
+    u_int32_t start = now - now % tiers[tier].resolution;
+    struct SFTELEM_BUCKET *bucket = &ring[s->head[tier]];
+    if (bucket->start == 0 || start > bucket->start)
+    { // clock going backwards keeps the current bucket
+        if (bucket->start != 0)
+        {
+            s->head[tier] = (s->head[tier] + 1) % tiers[tier].length;
+            bucket = &ring[s->head[tier]];
+        }
+        memset(bucket, 0, sizeof(struct SFTELEM_BUCKET));
+        bucket->start = start;
+    }
+    return bucket;
+}
+
+// add successful status read of device
+void telemetry_record(int id, double voltage_min, double voltage_avg, double voltage_max, u_int16_t sags,
+                      u_int32_t counter, u_int8_t status)
+{
+    struct SFTELEM_SERIES *s = seriesGet(id, 1);
+    if (s == NULL)
+    {
+        return;
+    }
+    u_int32_t now = time(NULL);
+    // counter restarts after reset of device
+    u_int32_t rotations = s->has_last && counter >= s->last_counter ? counter - s->last_counter : 0;
+    int changed = s->has_last && status != s->last_status;
+    for (int tier = 0; tier < SFTELEM_TIERS; tier++)
+    {
+        struct SFTELEM_BUCKET *bucket = bucketAt(s, tier, now);
+        if (bucket->samples == 0 || voltage_min < bucket->voltage_min)
+        {
+            bucket->voltage_min = voltage_min;
+        }
+        if (bucket->samples == 0 || voltage_max > bucket->voltage_max)
+        {
+            bucket->voltage_max = voltage_max;
+        }
+        bucket->voltage_sum += voltage_avg;
+        if (bucket->samples < 0xFFFF)
+        {
+            bucket->samples++;
+        }
+        bucket->rotations += rotations;
+        bucket->sags = bucket->sags + sags > 0xFFFF ? 0xFFFF : bucket->sags + sags;
+        bucket->status = status;
+        bucket->status_or |= status;
+        if (changed && bucket->changes < 0xFF)
+        {
+            bucket->changes++;
+        }
+    }
+    s->has_last = 1;
+    s->last_status = status;
+    s->last_counter = counter;
+}
+
+// add failed status read of device
+void telemetry_offline(int id)
+{
+    struct SFTELEM_SERIES *s = seriesGet(id, 1);
+    if (s == NULL)
+    {
+        return;
+    }
+    u_int32_t now = time(NULL);
+    for (int tier = 0; tier < SFTELEM_TIERS; tier++)
+    {
+        struct SFTELEM_BUCKET *bucket = bucketAt(s, tier, now);
+        if (bucket->offline < 0xFFFF)
+        {
+            bucket->offline++;
+        }
+    }
+}
+
+// drop series of device, e.g. if id is reused
+void telemetry_clear(int id)
+{
+    if (id < 0 || id >= seriesCapacity || series[id] == NULL)
+    {
+        return;
+    }
+    free(series[id]->buckets);
+    free(series[id]);
+    series[id] = NULL;
+}
+
+// add buckets of tier with given resolution (s) between from and to (unix time in s, 0 = unlimited)
+// to res. returns -1 if resolution is not available
+int telemetry_query(int id, int resolution, int64_t from, int64_t to, json_object *res)
+{
+    int tier = 0;
+    while (tier < SFTELEM_TIERS && tiers[tier].resolution != resolution)
+    {
+        tier++;
+    }
+    if (tier == SFTELEM_TIERS)
+    {
+        return -1;
+    }
+    json_object *samples = json_object_new_array();
+    struct SFTELEM_SERIES *s = seriesGet(id, 0);
+    if (s != NULL)
+    {
+        struct SFTELEM_BUCKET *ring = s->buckets + tierOffset(tier);
+        for (int i = 1; i <= tiers[tier].length; i++)
+        { // oldest first
+            struct SFTELEM_BUCKET *bucket = &ring[(s->head[tier] + i) % tiers[tier].length];
+            if (bucket->start == 0 || bucket->start < from || (to > 0 && bucket->start > to))
+            {
+                continue;
+            }
+            json_object *jbucket = json_object_new_object();
+            json_object_object_add(jbucket, "t", json_object_new_int64(bucket->start));
+            json_object_object_add(jbucket, "samples", json_object_new_int(bucket->samples));
+            json_object_object_add(jbucket, "offline", json_object_new_int(bucket->offline));
+            if (bucket->samples > 0)
+            {
+                json_object_object_add(jbucket, "voltageMin", json_object_new_double(bucket->voltage_min));
+                json_object_object_add(jbucket, "voltageMax", json_object_new_double(bucket->voltage_max));
+                json_object_object_add(jbucket, "voltageAvg",
+                                       json_object_new_double(bucket->voltage_sum / bucket->samples));
+                json_object_object_add(jbucket, "status", json_object_new_int(bucket->status));
+            }
+            json_object_object_add(jbucket, "rotations", json_object_new_int64(bucket->rotations));
+            json_object_object_add(jbucket, "rotationsPerMin",
+                                   json_object_new_double(bucket->rotations * 60.0 / resolution));
+            json_object_object_add(jbucket, "sags", json_object_new_int(bucket->sags));
+            json_object_object_add(jbucket, "statusSeen", json_object_new_int(bucket->status_or));
+            json_object_object_add(jbucket, "statusChanges", json_object_new_int(bucket->changes));
+            json_object_array_add(samples, jbucket);
+        }
+    }
+    json_object_object_add(res, "resolution", json_object_new_int(resolution));
+    json_object_object_add(res, "samples", samples);
+    return 0;
+}
+
+// polls status of all devices, so series have samples while the display is idle.
+// devices that do not fit into the airtime budget of polling are skipped
+static void *telemetry_loop(void *arg)
+{
+    pthread_mutex_lock(&pollLock);
+    while (1)
+    {
+        if (pollInterval <= 0)
+        {
+            pthread_cond_wait(&pollCond, &pollLock);
+            continue;
+        }
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += pollInterval;
+        if (pthread_cond_timedwait(&pollCond, &pollLock, &until) == 0)
+        { // interval changed
+            continue;
+        }
+        pthread_mutex_unlock(&pollLock);
+        devicemgr_lock();
+        devicemgr_poll();
+        devicemgr_unlock();
+        pthread_mutex_lock(&pollLock);
+    }
+    return NULL;
+}
+
+void telemetry_start()
+{
+    pthread_create(&pollThread, NULL, telemetry_loop, NULL);
+}
+
+// set poll interval in s, 0 disables polling
+void telemetry_interval(int seconds)
+{
+    pthread_mutex_lock(&pollLock);
+    pollInterval = seconds < 0 ? 0 : seconds;
+    pthread_cond_signal(&pollCond);
+    pthread_mutex_unlock(&pollLock);
+}
+
+int telemetry_getInterval()
+{
+    pthread_mutex_lock(&pollLock);
+    int seconds = pollInterval;
+    pthread_mutex_unlock(&pollLock);
+    return seconds;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ */
+
+#pragma once
+#include "devicemgr.h"
+
+#define SFTELEM_TIERS 3          // resolutions per device, see tiers in telemetry.c
+#define SFTELEM_POLL_DEF 0       // default poll interval in s, 0 = only record status reads of other commands
+
+// aggregated status reads of one time bucket
+struct SFTELEM_BUCKET
+{
+    u_int32_t start;     // unix time in s, 0 if unused
+    u_int16_t samples;   // successful status reads
+    u_int16_t offline;   // failed status reads
+    float voltage_min;   // lowest voltage
+    float voltage_max;   // highest voltage
+    float voltage_sum;   // sum of average voltages, divide by samples
+    u_int32_t rotations; // rotations counted in bucket
+    u_int16_t sags;      // voltage sag events
+    u_int8_t status;     // last status flags
+    u_int8_t status_or;  // all status flags seen
+    u_int8_t changes;    // status changes, saturates at 255
+};
+
+// time series of one device. each tier is a ring of buckets with samples, gaps use no memory
+struct SFTELEM_SERIES
+{
+    u_int8_t has_last;       // last_* is valid
+    u_int8_t last_status;    // status of previous read, to count changes
+    u_int32_t last_counter;  // rotation counter of previous read, to count rotations
+    int head[SFTELEM_TIERS]; // newest bucket of tier
+    struct SFTELEM_BUCKET *buckets; // all tiers, see tiers in telemetry.c
+};
+
+void telemetry_start();
+void telemetry_interval(int seconds);
+int telemetry_getInterval();
+void telemetry_record(int id, double voltage_min, double voltage_avg, double voltage_max, u_int16_t sags,
+                      u_int32_t counter, u_int8_t status);
+void telemetry_offline(int id);
+void telemetry_clear(int id);
+int telemetry_query(int id, int resolution, int64_t from, int64_t to, json_object *res);
@@ -0,0 +1,65 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This section runs the move checks of the device manager in the
+ * background. Every move is checked after its expected end, failed moves
+ * are sent again (see devicemgr_verify).
+ */
+
+#include "verifier.h"
+#include <pthread.h>
+#include <time.h>
+
+pthread_mutex_t verifyLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t verifyCond = PTHREAD_COND_INITIALIZER;
+pthread_t verifyThread;
+int verifyKicked = 0;
+
+static void *verifier_loop(void *arg)
+{
+    int next = -1;
+    pthread_mutex_lock(&verifyLock);
+    while (1)
+    {
+        if (!verifyKicked && next < 0)
+        {
+            pthread_cond_wait(&verifyCond, &verifyLock);
+        }
+        else if (!verifyKicked && next > 0)
+        {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += next / 1000;
+            until.tv_nsec += (next % 1000) * 1000000L;
+            if (until.tv_nsec >= 1000000000L)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&verifyCond, &verifyLock, &until);
+        }
+        verifyKicked = 0;
+        pthread_mutex_unlock(&verifyLock);
+        devicemgr_lock();
+        next = devicemgr_verify();
+        devicemgr_unlock();
+        pthread_mutex_lock(&verifyLock);
+    }
+    return NULL;
+}
+
+void verifier_start()
+{
+    pthread_create(&verifyThread, NULL, verifier_loop, NULL);
+}
+
+// new moves were added, recalculate next check. May be called with the bus lock held
+void verifier_kick()
+{
+    pthread_mutex_lock(&verifyLock);
+    verifyKicked = 1;
+    pthread_cond_signal(&verifyCond);
+    pthread_mutex_unlock(&verifyLock);
+}
@@ -0,0 +1,14 @@
+/*
+ * This file is part of the split-flap project.
+ * Copyright (c) 2024-2025 GuniaLabs (www.dennisgunia.de)
+ * Authors: Dennis Gunia
+ *
+ * This program is licenced under AGPL-3.0 license.
+ *
+ */
+
+#pragma once
+#include "devicemgr.h"
+
+void verifier_start();
+void verifier_kick();